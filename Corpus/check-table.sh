@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+#  check-table.sh
+#  Nurikabe
+#
+#  Counts the solutions of repeated.txt with and without a transposition table, on one thread and on several,
+#  and fails if any puzzle doesn't report its full number of solutions. The second copy of every puzzle is answered
+#  from what counting the first copy stored in the table, which used to be capped at two solutions.
+#
+#  Usage: Corpus/check-table.sh <path to nurikabe>
+
+nurikabe=${1:?Usage: $0 <path to nurikabe>}
+corpus=$(dirname "$0")/repeated.txt
+expected="open-3x3-a 4
+open-3x3-b 4
+multi-7x7-0-a 6
+multi-7x7-0-b 6
+multi-7x7-1-a 8
+multi-7x7-1-b 8"
+
+status=0
+for options in "--threads 1" "--threads 1 --table 1" "--threads 4 --table 1"
+do
+    counts=$("$nurikabe" --batch "$corpus" --count 10 --order input $options 2>/dev/null | cut -d ' ' -f 1,2)
+    if [ "$counts" != "$expected" ]
+    then
+        echo "Wrong solution counts with $options:"
+        echo "$counts"
+        status=1
+    fi
+done
+
+[ $status -eq 0 ] && echo "Solution counts match with and without the table"
+exit $status
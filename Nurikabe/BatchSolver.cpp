@@ -0,0 +1,236 @@
+//
+//  BatchSolver.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "BatchSolver.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+namespace
+{
+    const char* usage =
+    "Usage: Nurikabe --batch <corpus file or - for standard input> [options]\n"
+    "  --threads <n>               Worker threads (default one per hardware thread)\n"
+    "  --order <input|completion>  The order results are printed in (default input)\n"
+    "  --table <megabytes>         Share a transposition table of this size between the workers so searched states that come up again are skipped\n"
+    "  --count <limit>             Count the solutions of every puzzle up to limit instead of solving it, 2 checks that the solution is unique\n"
+    "  --backend <search|sat|auto> Finish puzzles the rules get stuck on with search or the SAT backend, auto picks by size and difficulty (default search)\n"
+    "  --sat-cells <n>             The fewest cells a hard puzzle needs for auto to pick the SAT backend (default 400)\n";
+}
+
+BatchSolver::BatchSolver(unsigned threadCount, Order anOrder, ResultHandler aHandler, int aSolutionLimit):
+order(anOrder),
+handler(aHandler),
+solutionLimit(aSolutionLimit),
+pool(threadCount)
+{
+    grids.resize(pool.threadCount());
+    satBackends.resize(pool.threadCount());
+    // Enough work to keep every worker busy while a slow puzzle holds back the results in input order
+    maxUndelivered = 64 * pool.threadCount();
+}
+
+BatchSolver::~BatchSolver()
+{
+    finish();
+}
+
+void BatchSolver::submit(const CorpusPuzzle& puzzle)
+{
+    size_t index;
+    {
+        unique_lock<mutex> lock(resultMutex);
+        resultDelivered.wait(lock, [this] { return submittedCount - deliveredCount < maxUndelivered; });
+        index = submittedCount++;
+    }
+    pool.submit([this, index, puzzle](unsigned workerIndex) { solvePuzzle(workerIndex, index, puzzle); });
+}
+
+void BatchSolver::finish()
+{
+    pool.wait();
+}
+
+void BatchSolver::solvePuzzle(unsigned workerIndex, size_t index, const CorpusPuzzle& puzzle)
+{
+    auto& grid = grids[workerIndex];
+    if (grid == nullptr)
+    {
+        grid.reset(new Grid(puzzle.width, puzzle.height));
+        grid->setTranspositionTable(transpositionTable);
+    }
+    else
+    {
+        grid->reset(puzzle.width, puzzle.height);
+    }
+    grid->loadClues(puzzle.clues);
+    
+    auto result = BatchResult();
+    result.index = index;
+    result.name = puzzle.name;
+    
+    const auto start = chrono::steady_clock::now();
+    if (solutionLimit > 0)
+    {
+        result.solutions = grid->countSolutions(solutionLimit);
+        result.solved = result.solutions > 0;
+    }
+    else if (backendPolicy.usesSat(puzzle))
+    {
+        auto& satBackend = satBackends[workerIndex];
+        if (satBackend == nullptr) { satBackend.reset(new SatBackend()); }
+        result.solved = satBackend->solve(*grid);
+        result.usedSat = true;
+    }
+    else
+    {
+        result.solved = grid->solveWithSearch();
+    }
+    const auto finish = chrono::steady_clock::now();
+    
+    result.nodes = grid->searchStats().nodes;
+    result.tableProbes = grid->searchStats().tableProbes;
+    result.tableHits = grid->searchStats().tableHits;
+    result.microseconds = chrono::duration<double, micro>(finish - start).count();
+    if (solutionLimit == 0) { result.cells = grid->cellString(); }
+    deliver(move(result));
+}
+
+void BatchSolver::deliver(BatchResult&& result)
+{
+    lock_guard<mutex> lock(resultMutex);
+    if (order == Order::Completion)
+    {
+        handler(result);
+        deliveredCount++;
+    }
+    else
+    {
+        pendingResults.emplace(result.index, move(result));
+        // Hand over every result that is now next in line, the first one is usually the one that was just added
+        for (auto next = pendingResults.begin(); next != pendingResults.end() && next->first == nextResultIndex; next = pendingResults.erase(next))
+        {
+            handler(next->second);
+            nextResultIndex++;
+            deliveredCount++;
+        }
+    }
+    resultDelivered.notify_all();
+}
+
+int runBatch(int argc, const char* argv[])
+{
+    string corpusPath;
+    unsigned threadCount = 0;
+    auto order = BatchSolver::Order::Input;
+    int solutionLimit = 0;
+    size_t tableMegabytes = 0;
+    auto backendPolicy = BackendPolicy();
+    
+    // argv[1] is --batch
+    for (int i = 2; i < argc; i++)
+    {
+        const string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (argument == "--threads" && hasValue) { threadCount = static_cast<unsigned>(max(0, atoi(argv[++i]))); }
+        else if (argument == "--order" && hasValue && string(argv[i + 1]) == "input") { order = BatchSolver::Order::Input; i++; }
+        else if (argument == "--order" && hasValue && string(argv[i + 1]) == "completion") { order = BatchSolver::Order::Completion; i++; }
+        else if (argument == "--table" && hasValue && atoi(argv[i + 1]) > 0) { tableMegabytes = static_cast<size_t>(atoi(argv[++i])); }
+        else if (argument == "--count" && hasValue && atoi(argv[i + 1]) > 0) { solutionLimit = atoi(argv[++i]); }
+        else if (argument == "--backend" && hasValue && BackendPolicy::parseBackend(argv[i + 1], backendPolicy.backend)) { i++; }
+        else if (argument == "--sat-cells" && hasValue && atoi(argv[i + 1]) > 0) { backendPolicy.minimumCells = atoi(argv[++i]); }
+        else if (corpusPath.empty() && (argument == "-" || argument[0] != '-')) { corpusPath = argument; }
+        else
+        {
+            cerr << usage;
+            return 2;
+        }
+    }
+    if (corpusPath.empty())
+    {
+        cerr << usage;
+        return 2;
+    }
+    
+    CorpusReader reader(corpusPath);
+    if (!reader.error().empty())
+    {
+        cerr << reader.error() << endl;
+        return 1;
+    }
+    
+    size_t puzzleCount = 0;
+    size_t unsolvedCount = 0;
+    // Counting mode sorts the puzzles by how many solutions they have, puzzles at the limit may have more
+    size_t uniqueCount = 0;
+    size_t ambiguousCount = 0;
+    size_t satCount = 0;
+    long tableProbes = 0;
+    long tableHits = 0;
+    unique_ptr<TranspositionTable> table;
+    if (tableMegabytes > 0) { table.reset(new TranspositionTable(tableMegabytes << 20)); }
+    const auto start = chrono::steady_clock::now();
+    unsigned usedThreads;
+    {
+        BatchSolver solver(threadCount, order, [&](const BatchResult& result) {
+            if (!result.solved) { unsolvedCount++; }
+            if (result.usedSat) { satCount++; }
+            tableProbes += result.tableProbes;
+            tableHits += result.tableHits;
+            if (solutionLimit == 0)
+            {
+                printf("%s %d %.1f %s\n", result.name.c_str(), result.solved ? 1 : 0, result.microseconds, result.cells.c_str());
+                return;
+            }
+            
+            if (result.solutions == 1) { uniqueCount++; }
+            if (result.solutions > 1) { ambiguousCount++; }
+            printf("%s %d %ld %.1f\n", result.name.c_str(), result.solutions, result.nodes, result.microseconds);
+        }, solutionLimit);
+        usedThreads = solver.threadCount();
+        solver.setTranspositionTable(table.get());
+        solver.setBackendPolicy(backendPolicy);
+        
+        auto puzzle = CorpusPuzzle();
+        while (reader.next(puzzle))
+        {
+            solver.submit(puzzle);
+            puzzleCount++;
+        }
+        solver.finish();
+    }
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    fflush(stdout);
+    
+    if (!reader.error().empty())
+    {
+        cerr << reader.error() << endl;
+        return 1;
+    }
+    
+    if (table != nullptr)
+    {
+        fprintf(stderr, "Transposition table: %.1f MB, %zu of %zu entries used, %ld of %ld lookups hit (%.1f%%)\n", table->memoryBytes() / 1048576.0,
+                table->occupiedEntries(), table->capacity(), tableHits, tableProbes, tableProbes > 0 ? 100.0 * tableHits / tableProbes : 0);
+    }
+    
+    if (solutionLimit > 0)
+    {
+        fprintf(stderr, "%zu puzzles on %u threads in %.3f s, %.0f puzzles/s, %zu with no solution, %zu unique, %zu with more than one\n",
+                puzzleCount, usedThreads, seconds, seconds > 0 ? puzzleCount / seconds : 0, unsolvedCount, uniqueCount, ambiguousCount);
+        // With a limit of 1 every solvable puzzle counts as fine because uniqueness wasn't checked
+        return unsolvedCount == 0 && (solutionLimit == 1 || ambiguousCount == 0) ? 0 : 1;
+    }
+    
+    fprintf(stderr, "%zu puzzles on %u threads in %.3f s, %.0f puzzles/s, %zu unsolved", puzzleCount, usedThreads, seconds, seconds > 0 ? puzzleCount / seconds : 0, unsolvedCount);
+    if (backendPolicy.backend != SolverBackend::Search) { fprintf(stderr, ", %zu by the SAT backend", satCount); }
+    fprintf(stderr, "\n");
+    return unsolvedCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+//
+//  BatchSolver.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef BatchSolver_hpp
+#define BatchSolver_hpp
+
+#include "Corpus.hpp"
+#include "Grid.hpp"
+#include "SatBackend.hpp"
+#include "ThreadPool.hpp"
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// The outcome of solving one puzzle of a batch
+struct BatchResult
+{
+    /// The position of the puzzle in the order it was submitted, starting at 0
+    size_t index = 0;
+    std::string name;
+    bool solved = false;
+    /// The solutions that were counted when the solver counts solutions, never more than the solution limit
+    int solutions = 0;
+    /// Search nodes visited and transposition table lookups, see Grid::SearchStats
+    long nodes = 0;
+    long tableProbes = 0;
+    long tableHits = 0;
+    /// True when the SAT backend solved the puzzle, see BackendPolicy
+    bool usedSat = false;
+    double microseconds = 0;
+    /// The grid after solving, see Grid::cellString. Empty when the solver counts solutions.
+    std::string cells;
+};
+
+/// Solves a stream of puzzles at the same time on a work stealing thread pool.
+///
+/// - Discussion: Every worker thread owns one Grid that it resets for each puzzle so workers never share solver state and the grid's storage is reused from puzzle to puzzle.
+/// The only state the workers share is the queue of results waiting to be handed to the result handler.
+/// Puzzles can be submitted while earlier ones are being solved, submit blocks when too many results are waiting so memory stays bounded however long the stream is.
+class BatchSolver
+{
+public:
+    /// The order the result handler sees results in
+    enum class Order
+    {
+        Input,      // The order the puzzles were submitted, a slow puzzle holds back the results after it
+        Completion  // The order the puzzles finished
+    };
+    
+    /// Called once per puzzle, never from two threads at the same time
+    typedef std::function<void(const BatchResult&)> ResultHandler;
+    
+    /// - Parameters:
+    ///     - threadCount: The number of worker threads, 0 uses one per hardware thread
+    ///     - order: The order results are passed to handler
+    ///     - handler: Receives every result, it is called on the worker threads
+    ///     - solutionLimit: When this is more than 0 the solutions of every puzzle are counted up to this limit with Grid::countSolutions instead of solving it
+    BatchSolver(unsigned threadCount, Order order, ResultHandler handler, int solutionLimit = 0);
+    
+    /// Waits for every submitted puzzle to be solved and handled
+    ~BatchSolver();
+    
+    BatchSolver(const BatchSolver&) = delete;
+    BatchSolver& operator=(const BatchSolver&) = delete;
+    
+    /// Shares table between the grids of every worker, see Grid::setTranspositionTable. Call it before the first puzzle is submitted.
+    void setTranspositionTable(TranspositionTable* table) { transpositionTable = table; };
+    
+    /// Chooses the puzzles that the SAT backend solves instead of Grid::solveWithSearch, counting solutions always uses search. Call it before the first puzzle is submitted.
+    void setBackendPolicy(const BackendPolicy& policy) { backendPolicy = policy; };
+    
+    void submit(const CorpusPuzzle& puzzle);
+    
+    /// Blocks until every puzzle submitted so far has been solved and passed to the result handler
+    void finish();
+    
+    unsigned threadCount() const { return pool.threadCount(); };
+
+private:
+    void solvePuzzle(unsigned workerIndex, size_t index, const CorpusPuzzle& puzzle);
+    void deliver(BatchResult&& result);
+    
+    Order order;
+    ResultHandler handler;
+    int solutionLimit;
+    TranspositionTable* transpositionTable = nullptr;
+    BackendPolicy backendPolicy;
+    
+    /// One grid per worker, only ever touched by the worker with the same index
+    std::vector<std::unique_ptr<Grid>> grids;
+    /// One SAT backend per worker, created the first time a worker gets a puzzle for it
+    std::vector<std::unique_ptr<SatBackend>> satBackends;
+    
+    // Guards everything below, the result handler is called with it held
+    std::mutex resultMutex;
+    std::condition_variable resultDelivered;
+    /// Finished results that are waiting for the results before them when the order is Input
+    std::map<size_t, BatchResult> pendingResults;
+    size_t nextResultIndex = 0;
+    size_t submittedCount = 0;
+    size_t deliveredCount = 0;
+    size_t maxUndelivered;
+    
+    // Declared last so that it is destroyed first, the workers have to stop before the grids they use go away
+    ThreadPool pool;
+};
+
+/// Runs batch mode, see the usage string in BatchSolver.cpp for the arguments
+///
+/// - Discussion: Puzzles are read from a corpus file or standard input as they are needed and one line is printed per puzzle: name solved microseconds cells,
+/// or name solutions nodes microseconds when counting solutions.
+/// A summary with the throughput is printed to standard error at the end.
+///
+/// - Returns: The exit code for the process
+int runBatch(int argc, const char* argv[]);
+
+#endif /* BatchSolver_hpp */
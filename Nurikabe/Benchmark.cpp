@@ -0,0 +1,368 @@
+//
+//  Benchmark.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "Benchmark.hpp"
+#include "Corpus.hpp"
+#include "Grid.hpp"
+#include "ParallelProber.hpp"
+#include "ParallelSearch.hpp"
+#include "SatBackend.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <sstream>
+
+using namespace std;
+
+#ifdef NURIKABE_COUNT_ALLOCATIONS
+namespace
+{
+    // Built with -DNURIKABE_COUNT_ALLOCATIONS every heap allocation in the process goes through the replacement operators below so the benchmark can count them.
+    // The count is per thread so that batch workers allocating at the same time don't fight over one counter, the benchmark only reads it from the thread doing the solve.
+    // C++14 has no aligned operator new so the plain and nothrow forms cover every allocation, the array forms call them.
+    thread_local long allocationCount = 0;
+}
+
+// Kept out of line so the compiler doesn't see free called on memory from operator new and warn that the two don't match
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    allocationCount++;
+    if (void* memory = malloc(size == 0 ? 1 : size)) { return memory; }
+    throw bad_alloc();
+}
+
+__attribute__((noinline)) void* operator new(size_t size, const nothrow_t&) noexcept
+{
+    allocationCount++;
+    return malloc(size == 0 ? 1 : size);
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, const nothrow_t&) noexcept
+{
+    free(memory);
+}
+#endif
+
+namespace
+{
+    /// Whether the allocs column means anything, without NURIKABE_COUNT_ALLOCATIONS the global operators are left alone and allocations aren't counted
+    #ifdef NURIKABE_COUNT_ALLOCATIONS
+    const bool countsAllocations = true;
+    long allocationsSoFar() { return allocationCount; }
+    #else
+    const bool countsAllocations = false;
+    long allocationsSoFar() { return 0; }
+    #endif
+}
+
+namespace
+{
+    const char* usage =
+    "Usage: Nurikabe --bench <corpus file> [options]\n"
+    "  --iterations <n>        Timed solves of every puzzle (default 100)\n"
+    "  --warmup <n>            Untimed solves of every puzzle before timing (default 10)\n"
+    "  --baseline <file>       Compare the median latency and allocations against a baseline file\n"
+    "  --write-baseline <file> Write the results as a baseline file\n"
+    "  --threshold <percent>   How much slower than the baseline a puzzle has to be to be flagged (default 10)\n"
+    "  --generic               Solve with the runtime sized rules even for the sizes that have a fixed size path\n"
+    "  --threads <n>           Search each puzzle on n threads with ParallelSearch, 0 uses one per hardware thread (default 1).\n"
+    "                          Only the allocations of the calling thread are counted\n"
+    "  --probe                 Finish the rules with the failed literal probing stage, see Grid::probingEnabled\n"
+    "  --probe-threads <n>     Probe on n threads with ParallelProber, implies --probe\n"
+    "  --backend <name>        search, sat or auto: finish the puzzles the rules get stuck on with search or the SAT backend, auto picks by size and difficulty (default search).\n"
+    "                          Puzzles that go to the SAT backend are timed with native search as well and the two are compared\n"
+    "  --sat-cells <n>         The fewest cells a hard puzzle needs for auto to pick the SAT backend (default 400)\n";
+    
+    struct BenchmarkResult
+    {
+        string name;
+        bool solved = false;
+        double minNanoseconds = 0;
+        double medianNanoseconds = 0;
+        double p99Nanoseconds = 0;
+        double solvesPerSecond = 0;
+        /// -1 when allocations aren't counted
+        double allocationsPerSolve = -1;
+    };
+    
+    struct BaselineEntry
+    {
+        double medianNanoseconds = 0;
+        double allocationsPerSolve = 0;
+    };
+    
+    /// - Parameters:
+    ///     - satBackend: Solves with the SAT backend when it isn't null, otherwise with search
+    BenchmarkResult benchmarkPuzzle(const CorpusPuzzle& puzzle, int warmup, int iterations, bool fixedGeometry, ParallelSearch* parallelSearch, bool probing, ParallelProber* prober,
+                                    SatBackend* satBackend)
+    {
+        auto result = BenchmarkResult();
+        result.name = puzzle.name;
+        result.solved = true;
+        
+        auto samples = vector<double>();
+        samples.reserve(iterations);
+        long allocations = 0;
+        double totalNanoseconds = 0;
+        
+        // One grid is reused the way a batch worker reuses it so the allocation count is the steady state one
+        Grid grid(puzzle.width, puzzle.height);
+        grid.fixedGeometryEnabled = fixedGeometry;
+        grid.probingEnabled = probing;
+        if (prober != nullptr) { prober->attach(grid); }
+        for (int i = 0; i < warmup + iterations; i++)
+        {
+            // Only the solve is timed, resetting and loading the grid is setup
+            grid.reset(puzzle.width, puzzle.height);
+            grid.loadClues(puzzle.clues);
+            
+            const long allocationsBefore = allocationsSoFar();
+            const auto start = chrono::steady_clock::now();
+            bool solved;
+            if (satBackend != nullptr) { solved = satBackend->solve(grid); }
+            else { solved = parallelSearch == nullptr ? grid.solveWithSearch() : parallelSearch->solve(grid); }
+            const auto finish = chrono::steady_clock::now();
+            const long allocationsAfter = allocationsSoFar();
+            
+            result.solved = result.solved && solved;
+            if (i < warmup) { continue; }
+            
+            const double nanoseconds = chrono::duration<double, nano>(finish - start).count();
+            samples.push_back(nanoseconds);
+            totalNanoseconds += nanoseconds;
+            allocations += allocationsAfter - allocationsBefore;
+        }
+        
+        sort(samples.begin(), samples.end());
+        result.minNanoseconds = samples.front();
+        result.medianNanoseconds = samples[samples.size() / 2];
+        result.p99Nanoseconds = samples[min(samples.size() - 1, static_cast<size_t>(ceil(samples.size() * 0.99)) - 1)];
+        result.solvesPerSecond = totalNanoseconds > 0 ? iterations / (totalNanoseconds / 1e9) : 0;
+        if (countsAllocations) { result.allocationsPerSolve = static_cast<double>(allocations) / iterations; }
+        return result;
+    }
+    
+    /// Baseline files have one line per puzzle: name medianNanoseconds allocationsPerSolve, the allocations are -1 when they weren't counted
+    bool loadBaseline(const string& path, map<string, BaselineEntry>& baseline)
+    {
+        ifstream file(path);
+        if (!file) { return false; }
+        
+        string line;
+        while (getline(file, line))
+        {
+            if (line.empty() || line[0] == '#') { continue; }
+            istringstream fields(line);
+            string name;
+            auto entry = BaselineEntry();
+            if (fields >> name >> entry.medianNanoseconds >> entry.allocationsPerSolve)
+            {
+                baseline[name] = entry;
+            }
+        }
+        return true;
+    }
+    
+    bool writeBaseline(const string& path, const vector<BenchmarkResult>& results)
+    {
+        ofstream file(path);
+        if (!file) { return false; }
+        
+        file << "# name medianNanoseconds allocationsPerSolve" << endl;
+        for (const auto& result : results)
+        {
+            file << result.name << " " << static_cast<long long>(result.medianNanoseconds) << " " << result.allocationsPerSolve << endl;
+        }
+        return true;
+    }
+    
+    string formatMicroseconds(double nanoseconds)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.1f", nanoseconds / 1000);
+        return buffer;
+    }
+}
+
+int runBenchmark(int argc, const char* argv[])
+{
+    string corpusPath;
+    string baselinePath;
+    string writeBaselinePath;
+    int iterations = 100;
+    int warmup = 10;
+    double threshold = 10;
+    bool fixedGeometry = true;
+    int threadCount = 1;
+    bool probing = false;
+    int probeThreadCount = 1;
+    auto backendPolicy = BackendPolicy();
+    
+    // argv[1] is --bench
+    for (int i = 2; i < argc; i++)
+    {
+        const string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (argument == "--iterations" && hasValue) { iterations = max(1, atoi(argv[++i])); }
+        else if (argument == "--warmup" && hasValue) { warmup = max(0, atoi(argv[++i])); }
+        else if (argument == "--baseline" && hasValue) { baselinePath = argv[++i]; }
+        else if (argument == "--write-baseline" && hasValue) { writeBaselinePath = argv[++i]; }
+        else if (argument == "--threshold" && hasValue) { threshold = atof(argv[++i]); }
+        else if (argument == "--generic") { fixedGeometry = false; }
+        else if (argument == "--threads" && hasValue) { threadCount = max(0, atoi(argv[++i])); }
+        else if (argument == "--probe") { probing = true; }
+        else if (argument == "--probe-threads" && hasValue)
+        {
+            probing = true;
+            probeThreadCount = max(0, atoi(argv[++i]));
+        }
+        else if (argument == "--backend" && hasValue && BackendPolicy::parseBackend(argv[i + 1], backendPolicy.backend)) { i++; }
+        else if (argument == "--sat-cells" && hasValue && atoi(argv[i + 1]) > 0) { backendPolicy.minimumCells = atoi(argv[++i]); }
+        else if (corpusPath.empty() && argument[0] != '-') { corpusPath = argument; }
+        else
+        {
+            cerr << usage;
+            return 2;
+        }
+    }
+    if (corpusPath.empty())
+    {
+        cerr << usage;
+        return 2;
+    }
+    
+    auto puzzles = vector<CorpusPuzzle>();
+    string error;
+    if (!loadCorpus(corpusPath, puzzles, error))
+    {
+        cerr << error << endl;
+        return 1;
+    }
+    
+    auto baseline = map<string, BaselineEntry>();
+    if (!baselinePath.empty() && !loadBaseline(baselinePath, baseline))
+    {
+        cerr << "Could not open baseline file " << baselinePath << endl;
+        return 1;
+    }
+    
+    printf("%-16s %7s %-7s %10s %10s %10s %10s %9s %10s %8s\n", "puzzle", "size", "level", "min us", "median us", "p99 us", "solves/s", "allocs", "baseline", "change");
+    
+    // Created once so the worker threads and their grids are reused for every solve like the single grid is
+    unique_ptr<ParallelSearch> parallelSearch;
+    if (threadCount != 1) { parallelSearch.reset(new ParallelSearch(static_cast<unsigned>(threadCount))); }
+    unique_ptr<ParallelProber> prober;
+    if (probeThreadCount != 1) { prober.reset(new ParallelProber(static_cast<unsigned>(probeThreadCount))); }
+    SatBackend satBackend;
+    
+    auto results = vector<BenchmarkResult>();
+    int unsolved = 0;
+    int regressions = 0;
+    double logRatioSum = 0;
+    int comparedCount = 0;
+    // The puzzles that went to the SAT backend and their medians with each backend
+    int satCount = 0;
+    double satMedianSum = 0;
+    double searchMedianSum = 0;
+    for (const auto& puzzle : puzzles)
+    {
+        const bool usesSat = backendPolicy.usesSat(puzzle);
+        const auto result = benchmarkPuzzle(puzzle, warmup, iterations, fixedGeometry, parallelSearch.get(), probing, prober.get(), usesSat ? &satBackend : nullptr);
+        results.push_back(result);
+        if (!result.solved) { unsolved++; }
+        
+        const string size = to_string(puzzle.width) + "x" + to_string(puzzle.height);
+        string baselineColumn = "-";
+        string changeColumn = "-";
+        const auto entry = baseline.find(puzzle.name);
+        if (entry != baseline.end() && entry->second.medianNanoseconds > 0)
+        {
+            const double ratio = result.medianNanoseconds / entry->second.medianNanoseconds;
+            char change[32];
+            snprintf(change, sizeof(change), "%+.1f%%", (ratio - 1) * 100);
+            baselineColumn = formatMicroseconds(entry->second.medianNanoseconds);
+            changeColumn = change;
+            logRatioSum += log(ratio);
+            comparedCount++;
+            if ((ratio - 1) * 100 > threshold)
+            {
+                changeColumn += " REGRESSION";
+                regressions++;
+            }
+            if (result.allocationsPerSolve >= 0 && entry->second.allocationsPerSolve >= 0 && result.allocationsPerSolve != entry->second.allocationsPerSolve)
+            {
+                char allocationChange[48];
+                snprintf(allocationChange, sizeof(allocationChange), " allocs %+.1f", result.allocationsPerSolve - entry->second.allocationsPerSolve);
+                changeColumn += allocationChange;
+            }
+        }
+        
+        string backendColumn;
+        if (usesSat)
+        {
+            const auto searchResult = benchmarkPuzzle(puzzle, warmup, iterations, fixedGeometry, parallelSearch.get(), probing, prober.get(), nullptr);
+            satCount++;
+            satMedianSum += result.medianNanoseconds;
+            searchMedianSum += searchResult.medianNanoseconds;
+            char comparison[64];
+            snprintf(comparison, sizeof(comparison), " sat, search %s us %.2fx", formatMicroseconds(searchResult.medianNanoseconds).c_str(),
+                     result.medianNanoseconds > 0 ? searchResult.medianNanoseconds / result.medianNanoseconds : 0);
+            backendColumn = comparison;
+        }
+        
+        char allocationsColumn[32] = "-";
+        if (result.allocationsPerSolve >= 0) { snprintf(allocationsColumn, sizeof(allocationsColumn), "%.1f", result.allocationsPerSolve); }
+        
+        printf("%-16s %7s %-7s %10s %10s %10s %10.0f %9s %10s %s%s%s\n",
+               puzzle.name.c_str(), size.c_str(), puzzle.difficulty.c_str(),
+               formatMicroseconds(result.minNanoseconds).c_str(),
+               formatMicroseconds(result.medianNanoseconds).c_str(),
+               formatMicroseconds(result.p99Nanoseconds).c_str(),
+               result.solvesPerSecond, allocationsColumn,
+               baselineColumn.c_str(), changeColumn.c_str(), backendColumn.c_str(),
+               result.solved ? "" : " UNSOLVED");
+    }
+    
+    double totalMedian = 0;
+    for (const auto& result : results) { totalMedian += result.medianNanoseconds; }
+    printf("\n%zu puzzles, sum of medians %s us", results.size(), formatMicroseconds(totalMedian).c_str());
+    if (comparedCount > 0)
+    {
+        printf(", geometric mean change against baseline %+.1f%%, %d regressions over %.0f%%", (exp(logRatioSum / comparedCount) - 1) * 100, regressions, threshold);
+    }
+    if (satCount > 0)
+    {
+        printf(", %d puzzles on the SAT backend in %s us against %s us with search (%.2fx)", satCount, formatMicroseconds(satMedianSum).c_str(), formatMicroseconds(searchMedianSum).c_str(),
+               satMedianSum > 0 ? searchMedianSum / satMedianSum : 0);
+    }
+    printf("\n");
+    
+    if (!writeBaselinePath.empty() && !writeBaseline(writeBaselinePath, results))
+    {
+        cerr << "Could not write baseline file " << writeBaselinePath << endl;
+        return 1;
+    }
+    
+    return unsolved == 0 ? 0 : 1;
+}
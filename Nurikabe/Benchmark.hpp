@@ -0,0 +1,20 @@
+//
+//  Benchmark.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+/// Runs the benchmark suite, see the usage string in Benchmark.cpp for the arguments
+///
+/// - Discussion: Every puzzle is solved with Grid::solveWithSearch a number of times after some untimed warmup runs.
+/// The min, median and p99 latency, solves per second and heap allocations per solve are reported for every puzzle and compared against a baseline file when one is given.
+/// Allocations are only counted in a build with NURIKABE_COUNT_ALLOCATIONS defined, which replaces the global operator new and delete.
+///
+/// - Returns: The exit code for the process
+int runBenchmark(int argc, const char* argv[]);
+
+#endif /* Benchmark_hpp */
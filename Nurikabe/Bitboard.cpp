@@ -0,0 +1,184 @@
+//
+//  Bitboard.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "Bitboard.hpp"
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+Bitboard::Bitboard(int aWidth, int aHeight)
+{
+    clear(aWidth, aHeight);
+}
+
+void Bitboard::clear(int aWidth, int aHeight)
+{
+    width = aWidth;
+    height = aHeight;
+    wordsPerRow = (aWidth + 63) / 64;
+    words.assign(wordsPerRow * aHeight + 1, 0);
+}
+
+namespace
+{
+    // Each set of lanes wraps the handful of bitwise operations the kernels need so the kernels can be written once for every instruction set
+    
+    struct ScalarLanes
+    {
+        typedef uint64_t Vector;
+        static const int wordCount = 1;
+        
+        static Vector load(const uint64_t* words) { return *words; }
+        static void store(uint64_t* words, Vector v) { *words = v; }
+        static Vector bitAnd(Vector a, Vector b) { return a & b; }
+        static Vector bitOr(Vector a, Vector b) { return a | b; }
+        static Vector bitXor(Vector a, Vector b) { return a ^ b; }
+        /// ~a & b
+        static Vector andNot(Vector a, Vector b) { return ~a & b; }
+        /// Moves every cell one column to the left so that each bit lines up with the cell to its right, the first cell of the next word moves into the top bit
+        static Vector loadShifted(const uint64_t* words) { return (words[0] >> 1) | (words[1] << 63); }
+    };
+    
+#if defined(__SSE2__)
+    struct SSE2Lanes
+    {
+        typedef __m128i Vector;
+        static const int wordCount = 2;
+        
+        static Vector load(const uint64_t* words) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(words)); }
+        static void store(uint64_t* words, Vector v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(words), v); }
+        static Vector bitAnd(Vector a, Vector b) { return _mm_and_si128(a, b); }
+        static Vector bitOr(Vector a, Vector b) { return _mm_or_si128(a, b); }
+        static Vector bitXor(Vector a, Vector b) { return _mm_xor_si128(a, b); }
+        static Vector andNot(Vector a, Vector b) { return _mm_andnot_si128(a, b); }
+        static Vector loadShifted(const uint64_t* words) { return _mm_or_si128(_mm_srli_epi64(load(words), 1), _mm_slli_epi64(load(words + 1), 63)); }
+    };
+#endif
+
+#if defined(__AVX2__)
+    struct AVX2Lanes
+    {
+        typedef __m256i Vector;
+        static const int wordCount = 4;
+        
+        static Vector load(const uint64_t* words) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words)); }
+        static void store(uint64_t* words, Vector v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(words), v); }
+        static Vector bitAnd(Vector a, Vector b) { return _mm256_and_si256(a, b); }
+        static Vector bitOr(Vector a, Vector b) { return _mm256_or_si256(a, b); }
+        static Vector bitXor(Vector a, Vector b) { return _mm256_xor_si256(a, b); }
+        static Vector andNot(Vector a, Vector b) { return _mm256_andnot_si256(a, b); }
+        static Vector loadShifted(const uint64_t* words) { return _mm256_or_si256(_mm256_srli_epi64(load(words), 1), _mm256_slli_epi64(load(words + 1), 63)); }
+    };
+#endif
+    
+    /// The four cells of every window in a block of words, topLeft and bottomLeft are the cells in the window's column and the others are the cells to their right
+    template <typename Lanes>
+    struct Window
+    {
+        Window(const uint64_t* words, int wordsPerRow):
+        topLeft(Lanes::load(words)),
+        topRight(Lanes::loadShifted(words)),
+        bottomLeft(Lanes::load(words + wordsPerRow)),
+        bottomRight(Lanes::loadShifted(words + wordsPerRow)) { }
+        
+        typename Lanes::Vector any() const { return Lanes::bitOr(Lanes::bitOr(topLeft, topRight), Lanes::bitOr(bottomLeft, bottomRight)); }
+        
+        typename Lanes::Vector topLeft;
+        typename Lanes::Vector topRight;
+        typename Lanes::Vector bottomLeft;
+        typename Lanes::Vector bottomRight;
+    };
+    
+    template <typename Lanes>
+    struct ElbowPattern
+    {
+        // Exactly three black cells means one row is all black and the other has exactly one black cell, the last cell has to be unknown rather than white
+        static typename Lanes::Vector match(const Window<Lanes>& black, const Window<Lanes>& unknown)
+        {
+            const auto topBoth = Lanes::bitAnd(black.topLeft, black.topRight);
+            const auto bottomBoth = Lanes::bitAnd(black.bottomLeft, black.bottomRight);
+            const auto topOne = Lanes::bitXor(black.topLeft, black.topRight);
+            const auto bottomOne = Lanes::bitXor(black.bottomLeft, black.bottomRight);
+            const auto threeBlack = Lanes::bitOr(Lanes::bitAnd(topBoth, bottomOne), Lanes::bitAnd(bottomBoth, topOne));
+            return Lanes::bitAnd(threeBlack, unknown.any());
+        }
+    };
+    
+    template <typename Lanes>
+    struct PoolCandidatePattern
+    {
+        // Exactly two black cells and no white cells leaves exactly two unknown cells
+        static typename Lanes::Vector match(const Window<Lanes>& black, const Window<Lanes>& white)
+        {
+            const auto topBoth = Lanes::bitAnd(black.topLeft, black.topRight);
+            const auto bottomBoth = Lanes::bitAnd(black.bottomLeft, black.bottomRight);
+            const auto topAny = Lanes::bitOr(black.topLeft, black.topRight);
+            const auto bottomAny = Lanes::bitOr(black.bottomLeft, black.bottomRight);
+            const auto topOne = Lanes::bitXor(black.topLeft, black.topRight);
+            const auto bottomOne = Lanes::bitXor(black.bottomLeft, black.bottomRight);
+            const auto twoBlack = Lanes::bitOr(Lanes::bitOr(Lanes::andNot(bottomAny, topBoth), Lanes::andNot(topAny, bottomBoth)), Lanes::bitAnd(topOne, bottomOne));
+            return Lanes::andNot(white.any(), twoBlack);
+        }
+    };
+    
+    /// Runs the pattern over words [start, end) of the first height - 1 rows, as many words at a time as the lanes hold
+    ///
+    /// - Returns: The index of the first word that was not processed because there weren't enough words left to fill the lanes
+    template <typename Lanes, template <typename> class Pattern>
+    size_t runPattern(const Bitboard& black, const Bitboard& other, Bitboard& result, size_t start, size_t end)
+    {
+        size_t i = start;
+        for (; i + Lanes::wordCount <= end; i += Lanes::wordCount)
+        {
+            const auto blackWindow = Window<Lanes>(black.words.data() + i, black.wordsPerRow);
+            const auto otherWindow = Window<Lanes>(other.words.data() + i, other.wordsPerRow);
+            Lanes::store(result.words.data() + i, Pattern<Lanes>::match(blackWindow, otherWindow));
+        }
+        return i;
+    }
+    
+    template <template <typename> class Pattern>
+    void findWindows(const Bitboard& black, const Bitboard& other, Bitboard& result)
+    {
+        fill(result.words.begin(), result.words.end(), 0);
+        if (black.height < 2 || black.width < 2) { return; }
+        
+        // Windows are found for every row but the last, the cells below come from the next row of words
+        const size_t end = (black.height - 1) * black.wordsPerRow;
+        size_t i = 0;
+    #if defined(__AVX2__)
+        i = runPattern<AVX2Lanes, Pattern>(black, other, result, i, end);
+    #endif
+    #if defined(__SSE2__)
+        i = runPattern<SSE2Lanes, Pattern>(black, other, result, i, end);
+    #endif
+        runPattern<ScalarLanes, Pattern>(black, other, result, i, end);
+        
+        // A window can't start in the last column, the cell to its right was read from the padding or the start of the next row
+        const int lastColumn = black.width - 1;
+        const uint64_t lastColumnBit = uint64_t(1) << (lastColumn % 64);
+        for (int y = 0; y < black.height - 1; y++)
+        {
+            auto& lastWord = result.words[y * black.wordsPerRow + lastColumn / 64];
+            lastWord &= lastColumnBit - 1;
+        }
+    }
+}
+
+void BitboardKernels::findElbowWindows(const Bitboard& black, const Bitboard& unknown, Bitboard& result)
+{
+    findWindows<ElbowPattern>(black, unknown, result);
+}
+
+void BitboardKernels::findPoolCandidateWindows(const Bitboard& black, const Bitboard& white, Bitboard& result)
+{
+    findWindows<PoolCandidatePattern>(black, white, result);
+}
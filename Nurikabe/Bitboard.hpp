@@ -0,0 +1,73 @@
+//
+//  Bitboard.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef Bitboard_hpp
+#define Bitboard_hpp
+
+#include <cstdint>
+#include <vector>
+
+/// A set of cells stored as one bit per cell. Every row starts on a new 64 bit word so the cell below a cell is always wordsPerRow words further on,
+/// that way the 2x2 window kernels can treat the rows of the board as one flat array of words and process as many words per instruction as the CPU allows.
+class Bitboard
+{
+public:
+    Bitboard(int width = 0, int height = 0);
+    
+    /// Clears every cell and changes the dimensions, the storage is reused when it is big enough
+    void clear(int width, int height);
+    
+    void set(int x, int y) { words[wordIndex(x, y)] |= bitForColumn(x); };
+    void reset(int x, int y) { words[wordIndex(x, y)] &= ~bitForColumn(x); };
+    bool test(int x, int y) const { return (words[wordIndex(x, y)] & bitForColumn(x)) != 0; };
+    
+    /// Calls visitor with the x and y coordinates of every set cell, in row order
+    template <typename Visitor>
+    void forEach(Visitor visitor) const;
+    
+    int width = 0;
+    int height = 0;
+    int wordsPerRow = 0;
+    
+    /// height * wordsPerRow words followed by one word of padding that is always zero so that kernels can read the word after the last word of a row.
+    /// Bits past the width of a row are always zero.
+    std::vector<uint64_t> words = std::vector<uint64_t>();
+
+private:
+    int wordIndex(int x, int y) const { return y * wordsPerRow + x / 64; };
+    static uint64_t bitForColumn(int x) { return uint64_t(1) << (x % 64); };
+};
+
+template <typename Visitor>
+void Bitboard::forEach(Visitor visitor) const
+{
+    for (int y = 0; y < height; y++)
+    {
+        for (int i = 0; i < wordsPerRow; i++)
+        {
+            uint64_t word = words[y * wordsPerRow + i];
+            while (word != 0)
+            {
+                visitor(i * 64 + __builtin_ctzll(word), y);
+                word &= word - 1;
+            }
+        }
+    }
+}
+
+/// Kernels that look at every 2x2 window of the grid at once. The result has the bit of the top left cell of every matching window set.
+/// Each kernel is built with AVX2 when the compiler targets it, SSE2 otherwise and falls back to plain 64 bit words on other CPUs.
+namespace BitboardKernels
+{
+    /// Windows with three black cells and one unknown cell, the unknown cell is the elbow and must be white
+    void findElbowWindows(const Bitboard& black, const Bitboard& unknown, Bitboard& result);
+    
+    /// Windows with two black cells and two unknown cells, the candidates for the guessing unreachable rule
+    void findPoolCandidateWindows(const Bitboard& black, const Bitboard& white, Bitboard& result);
+}
+
+#endif /* Bitboard_hpp */
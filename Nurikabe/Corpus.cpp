@@ -0,0 +1,321 @@
+//
+//  Corpus.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "Corpus.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    /// The largest number a text corpus cell can hold, well past anything that fits on a grid we can solve
+    const long maxClueNumber = 65535;
+    
+    bool isSpace(char character) { return character == ' ' || character == '\t' || character == '\r'; }
+    
+    /// Moves begin past any whitespace and returns the next whitespace separated field in [fieldBegin, fieldEnd)
+    bool nextField(const char*& begin, const char* end, const char*& fieldBegin, const char*& fieldEnd)
+    {
+        while (begin != end && isSpace(*begin)) { begin++; }
+        fieldBegin = begin;
+        while (begin != end && !isSpace(*begin)) { begin++; }
+        fieldEnd = begin;
+        return fieldBegin != fieldEnd;
+    }
+    
+    /// Parses a positive decimal number that fills the whole of [begin, end)
+    bool parseNumber(const char* begin, const char* end, long maximum, long& number)
+    {
+        if (begin == end) { return false; }
+        number = 0;
+        for (auto i = begin; i != end; ++i)
+        {
+            if (*i < '0' || *i > '9') { return false; }
+            number = number * 10 + (*i - '0');
+            if (number > maximum) { return false; }
+        }
+        return true;
+    }
+    
+    uint32_t readLittleEndian(const char* bytes, int byteCount)
+    {
+        uint32_t value = 0;
+        for (int i = byteCount - 1; i >= 0; i--)
+        {
+            value = (value << 8) | static_cast<unsigned char>(bytes[i]);
+        }
+        return value;
+    }
+    
+    void writeLittleEndian(ostream& stream, uint32_t value, int byteCount)
+    {
+        for (int i = 0; i < byteCount; i++)
+        {
+            stream.put(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (mapped) { munmap(const_cast<char*>(data), size); }
+}
+
+bool MappedFile::open(const string& path)
+{
+    const int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) { return false; }
+    
+    struct stat status;
+    if (fstat(descriptor, &status) != 0)
+    {
+        close(descriptor);
+        return false;
+    }
+    
+    size = static_cast<size_t>(status.st_size);
+    if (size > 0)
+    {
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapping == MAP_FAILED)
+        {
+            close(descriptor);
+            return false;
+        }
+        // The corpus is read front to back once so the kernel can read ahead aggressively and drop pages behind us
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapping);
+        mapped = true;
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(descriptor);
+    return true;
+}
+
+const char CorpusReader::binaryMagic[8] = { 'N', 'U', 'R', 'I', 'K', 'A', 'B', '1' };
+
+CorpusReader::CorpusReader(const string& path): sourceName(path)
+{
+    if (path == "-")
+    {
+        stream = &cin;
+        sourceName = "<stdin>";
+        return;
+    }
+    
+    if (!file.open(path))
+    {
+        lastError = "Could not open corpus file " + path;
+        return;
+    }
+    cursor = file.begin();
+    end = file.end();
+    binary = static_cast<size_t>(end - cursor) >= sizeof(binaryMagic) && memcmp(cursor, binaryMagic, sizeof(binaryMagic)) == 0;
+    if (binary) { cursor += sizeof(binaryMagic); }
+}
+
+bool CorpusReader::next(CorpusPuzzle& puzzle)
+{
+    if (!lastError.empty()) { return false; }
+    if (binary) { return nextBinary(puzzle); }
+    
+    while (true)
+    {
+        const char* lineBegin;
+        const char* lineEnd;
+        if (stream != nullptr)
+        {
+            if (!getline(*stream, line)) { return false; }
+            lineBegin = line.data();
+            lineEnd = lineBegin + line.size();
+        }
+        else
+        {
+            if (cursor == end) { return false; }
+            lineBegin = cursor;
+            lineEnd = static_cast<const char*>(memchr(cursor, '\n', end - cursor));
+            if (lineEnd == nullptr) { lineEnd = end; }
+            cursor = lineEnd == end ? end : lineEnd + 1;
+        }
+        lineNumber++;
+        
+        auto firstCharacter = lineBegin;
+        while (firstCharacter != lineEnd && isSpace(*firstCharacter)) { firstCharacter++; }
+        if (firstCharacter == lineEnd || *firstCharacter == '#') { continue; }
+        
+        return parseLine(lineBegin, lineEnd, puzzle);
+    }
+}
+
+bool CorpusReader::parseLine(const char* begin, const char* end, CorpusPuzzle& puzzle)
+{
+    const char* fields[5][2];
+    for (auto& field : fields)
+    {
+        nextField(begin, end, field[0], field[1]);
+    }
+    
+    long width = 0;
+    long height = 0;
+    const char* trailingBegin;
+    const char* trailingEnd;
+    if (fields[4][0] == fields[4][1] || nextField(begin, end, trailingBegin, trailingEnd) ||
+        !parseNumber(fields[1][0], fields[1][1], 65535, width) || width == 0 ||
+        !parseNumber(fields[2][0], fields[2][1], 65535, height) || height == 0)
+    {
+        lastError = sourceName + ":" + to_string(lineNumber) + ": expected name width height difficulty cells";
+        return false;
+    }
+    
+    puzzle.name.assign(fields[0][0], fields[0][1]);
+    puzzle.width = static_cast<int>(width);
+    puzzle.height = static_cast<int>(height);
+    puzzle.difficulty.assign(fields[3][0], fields[3][1]);
+    puzzle.clues.clear();
+    
+    const long cellCount = width * height;
+    long index = 0;
+    // Every cell is counted, a line with too many is as malformed as one with too few
+    for (auto i = fields[4][0]; i != fields[4][1]; ++i, ++index)
+    {
+        if (*i == '.') { continue; }
+        
+        long number = 0;
+        if (*i >= '1' && *i <= '9')
+        {
+            number = *i - '0';
+        }
+        else if (*i == '(')
+        {
+            const auto numberEnd = static_cast<const char*>(memchr(i, ')', fields[4][1] - i));
+            if (numberEnd == nullptr || !parseNumber(i + 1, numberEnd, maxClueNumber, number) || number == 0)
+            {
+                lastError = sourceName + ":" + to_string(lineNumber) + ": malformed number in brackets";
+                return false;
+            }
+            i = numberEnd;
+        }
+        else
+        {
+            lastError = sourceName + ":" + to_string(lineNumber) + ": unexpected character '" + string(1, *i) + "' in cells";
+            return false;
+        }
+        puzzle.clues.push_back(Grid::Clue { static_cast<int>(index), static_cast<int>(number) });
+    }
+    
+    if (index != cellCount)
+    {
+        lastError = sourceName + ":" + to_string(lineNumber) + ": expected " + to_string(cellCount) + " cells";
+        return false;
+    }
+    return true;
+}
+
+bool CorpusReader::nextBinary(CorpusPuzzle& puzzle)
+{
+    if (cursor == end) { return false; }
+    recordNumber++;
+    
+    const size_t headerSize = 2 + 2 + 1 + 1 + 4;
+    const size_t clueSize = 4 + 2;
+    const size_t remaining = end - cursor;
+    const auto truncated = [this]() {
+        lastError = sourceName + ": record " + to_string(recordNumber) + " is truncated or malformed";
+        return false;
+    };
+    if (remaining < headerSize) { return truncated(); }
+    
+    const uint32_t width = readLittleEndian(cursor, 2);
+    const uint32_t height = readLittleEndian(cursor + 2, 2);
+    const uint32_t nameLength = readLittleEndian(cursor + 4, 1);
+    const uint32_t difficultyLength = readLittleEndian(cursor + 5, 1);
+    const uint32_t clueCount = readLittleEndian(cursor + 6, 4);
+    const uint64_t cellCount = static_cast<uint64_t>(width) * height;
+    if (width == 0 || height == 0 || clueCount > cellCount ||
+        remaining - headerSize < nameLength + difficultyLength + static_cast<uint64_t>(clueCount) * clueSize)
+    {
+        return truncated();
+    }
+    
+    auto field = cursor + headerSize;
+    puzzle.width = static_cast<int>(width);
+    puzzle.height = static_cast<int>(height);
+    puzzle.name.assign(field, nameLength);
+    field += nameLength;
+    puzzle.difficulty.assign(field, difficultyLength);
+    field += difficultyLength;
+    
+    puzzle.clues.clear();
+    long previousIndex = -1;
+    for (uint32_t i = 0; i < clueCount; i++, field += clueSize)
+    {
+        const uint32_t index = readLittleEndian(field, 4);
+        const uint32_t number = readLittleEndian(field + 4, 2);
+        // Indices have to increase so no cell can have two numbers
+        if (index >= cellCount || static_cast<long>(index) <= previousIndex || number == 0) { return truncated(); }
+        previousIndex = index;
+        puzzle.clues.push_back(Grid::Clue { static_cast<int>(index), static_cast<int>(number) });
+    }
+    cursor = field;
+    return true;
+}
+
+bool loadCorpus(const string& path, vector<CorpusPuzzle>& puzzles, string& error)
+{
+    CorpusReader reader(path);
+    auto puzzle = CorpusPuzzle();
+    while (reader.next(puzzle))
+    {
+        puzzles.push_back(puzzle);
+    }
+    error = reader.error();
+    return error.empty();
+}
+
+bool writeBinaryCorpus(const string& path, CorpusReader& reader, string& error)
+{
+    ofstream file(path, ios::binary);
+    if (!file)
+    {
+        error = "Could not open " + path + " for writing";
+        return false;
+    }
+    
+    file.write(CorpusReader::binaryMagic, sizeof(CorpusReader::binaryMagic));
+    auto puzzle = CorpusPuzzle();
+    while (reader.next(puzzle))
+    {
+        if (puzzle.name.size() > 255 || puzzle.difficulty.size() > 255 || puzzle.width > 65535 || puzzle.height > 65535)
+        {
+            error = "Puzzle " + puzzle.name + " doesn't fit in a binary record";
+            return false;
+        }
+        
+        writeLittleEndian(file, puzzle.width, 2);
+        writeLittleEndian(file, puzzle.height, 2);
+        writeLittleEndian(file, static_cast<uint32_t>(puzzle.name.size()), 1);
+        writeLittleEndian(file, static_cast<uint32_t>(puzzle.difficulty.size()), 1);
+        writeLittleEndian(file, static_cast<uint32_t>(puzzle.clues.size()), 4);
+        file << puzzle.name << puzzle.difficulty;
+        for (const auto& clue : puzzle.clues)
+        {
+            writeLittleEndian(file, clue.index, 4);
+            writeLittleEndian(file, clue.number, 2);
+        }
+    }
+    
+    error = reader.error();
+    if (error.empty() && !file) { error = "Could not write " + path; }
+    return error.empty();
+}
@@ -0,0 +1,108 @@
+//
+//  Corpus.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef Corpus_hpp
+#define Corpus_hpp
+
+#include "Grid.hpp"
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <vector>
+
+/// One puzzle from a corpus file
+struct CorpusPuzzle
+{
+    std::string name;
+    std::string difficulty;
+    int width = 0;
+    int height = 0;
+    /// The numbered cells in the format that Grid::loadClues expects, in increasing index order
+    std::vector<Grid::Clue> clues;
+};
+
+/// A read only memory mapping of a whole file. Pages are only read from disk when they are first touched so mapping a huge file is instant.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    /// - Returns: false if the file can't be opened or mapped
+    bool open(const std::string& path);
+    
+    const char* begin() const { return data; };
+    const char* end() const { return data + size; };
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    /// Empty files can't be mapped so they are only remembered as open
+    bool mapped = false;
+};
+
+/// Reads puzzles one at a time from a corpus so a corpus never has to be held in memory all at once. Two formats are understood and told apart by the first bytes of the file.
+///
+/// - Discussion: The text format has one puzzle per line, blank lines and comment lines, whose first character other than a space or tab is #, are skipped: name width height difficulty cells
+/// where cells is every cell of the grid in row order, a . for a cell without a number, a digit for a number up to 9 and a number in brackets such as (12) for any number.
+///
+/// The binary format starts with the 8 bytes NURIKAB1 followed by one record per puzzle, every integer is little endian:
+/// u16 width, u16 height, u8 name length, u8 difficulty length, u32 clue count, the name, the difficulty and then clue count clues of u32 flat index and u16 number in increasing index order.
+///
+/// Files are memory mapped and parsed in place. A path of - reads the text format from standard input line by line so puzzles can be solved as they arrive.
+class CorpusReader
+{
+public:
+    /// The bytes every binary corpus starts with
+    static const char binaryMagic[8];
+    
+    /// Opens the corpus, check error() before reading to see if that worked
+    explicit CorpusReader(const std::string& path);
+    
+    CorpusReader(const CorpusReader&) = delete;
+    CorpusReader& operator=(const CorpusReader&) = delete;
+    
+    /// Reads the next puzzle into puzzle, the storage of puzzle is reused so reading into the same puzzle over and over doesn't allocate
+    ///
+    /// - Returns: false at the end of the corpus or when it is malformed, error() is empty in the first case and describes the problem in the second
+    bool next(CorpusPuzzle& puzzle);
+    
+    const std::string& error() const { return lastError; };
+
+private:
+    /// Parses one line of the text format
+    ///
+    /// - Returns: false and sets lastError if the line is malformed
+    bool parseLine(const char* begin, const char* end, CorpusPuzzle& puzzle);
+    bool nextBinary(CorpusPuzzle& puzzle);
+    
+    std::string sourceName;
+    MappedFile file;
+    std::istream* stream = nullptr;
+    std::string line;
+    /// The unread part of the mapped file
+    const char* cursor = nullptr;
+    const char* end = nullptr;
+    bool binary = false;
+    int lineNumber = 0;
+    size_t recordNumber = 0;
+    std::string lastError;
+};
+
+/// Reads a whole corpus, see CorpusReader for the formats
+///
+/// - Returns: false if the file can't be opened or is malformed, error then describes the problem
+bool loadCorpus(const std::string& path, std::vector<CorpusPuzzle>& puzzles, std::string& error);
+
+/// Streams every puzzle that reader has left into a file in the binary corpus format, the whole corpus is never held in memory
+///
+/// - Returns: false if the file can't be written or the reader fails, error then describes the problem
+bool writeBinaryCorpus(const std::string& path, CorpusReader& reader, std::string& error);
+
+#endif /* Corpus_hpp */
@@ -7,20 +7,140 @@
 //
 
 #include "Grid.hpp"
+#include "GridSnapshot.hpp"
 #include <iostream>
 #include <algorithm>
 #include <queue>
+#include <chrono>
+#include <limits>
 
 using namespace std;
 
 Grid::Grid(int aWidth, int aHeight)
 {
-    // Init the grid with unknown cells of unknown coordinates
-    // We actually need these unknown cells in the grid before loadGrid is executed because Region's addCell method checks the adjacent cells so there has to be something there otherwise we get exc bad access
-    rows = vector<vector<Cell>>(aHeight, vector<Cell>(aWidth, Cell(Cell::Type::Unknown, Cell::Coordinate(-1,-1))));
+    reset(aWidth, aHeight);
+}
+
+void Grid::reset(int aWidth, int aHeight)
+{
     width = aWidth;
     height = aHeight;
-    totalBlackCells = width * height;
+    const int cellCount = aWidth * aHeight;
+    numberOfKnownCells = 0;
+    maxRegionSize = 0;
+    totalBlackCells = cellCount;
+    
+    // Init the grid with unknown cells, every cell array is a single contiguous block indexed by y * width + x
+    cellTypes.assign(cellCount, Cell::Type::Unknown);
+    cellNumbers.assign(cellCount, -1);
+    regionParents.assign(cellCount, -1);
+    // Region entries are only read once a region has been created at that index and creating a region resets the entry.
+    // The entries of the last puzzle are kept and only have their sets emptied so that the pool gets their nodes back.
+    for (auto& region : regionPool)
+    {
+        region.adjacentUnknownCells.clear();
+    }
+    regionPool.reserve(cellCount);
+    while (regionPool.size() < static_cast<size_t>(cellCount))
+    {
+        regionPool.emplace_back(nodePool);
+    }
+    regions.clear();
+    unknownCellCoords.clear();
+    
+    // The neighbours of every cell are looked up once here so that the rules never have to check bounds
+    neighbourTable.resize(cellCount);
+    for (int y = 0; y < aHeight; y++)
+    {
+        for (int x = 0; x < aWidth; x++)
+        {
+            auto& cellNeighbours = neighbourTable[y * aWidth + x];
+            cellNeighbours.count = 0;
+            if (y + 1 < aHeight) { cellNeighbours.indices[cellNeighbours.count++] = (y + 1) * aWidth + x; }
+            if (y > 0) { cellNeighbours.indices[cellNeighbours.count++] = (y - 1) * aWidth + x; }
+            if (x > 0) { cellNeighbours.indices[cellNeighbours.count++] = y * aWidth + x - 1; }
+            if (x + 1 < aWidth) { cellNeighbours.indices[cellNeighbours.count++] = y * aWidth + x + 1; }
+        }
+    }
+    
+    blackCells.clear(aWidth, aHeight);
+    whiteCells.clear(aWidth, aHeight);
+    unknownCells.clear(aWidth, aHeight);
+    matchedWindows.clear(aWidth, aHeight);
+    for (int y = 0; y < aHeight; y++)
+    {
+        for (int x = 0; x < aWidth; x++)
+        {
+            unknownCells.set(x, y);
+        }
+    }
+    
+    for (auto queue : { &completeRegionsQueue, &multipleAdjacencyQueue, &singlePathwayBlackQueue, &singlePathwayWhiteQueue, &n1Queue, &guessingWindowQueue })
+    {
+        queue->reset(cellCount);
+    }
+    elbowDirty = true;
+    unreachableDirty = true;
+    guessingUnreachableDirty = true;
+    contradiction = false;
+    
+    reachBudgets.assign(cellCount, 0);
+    reachBudgetsValid = false;
+    reachChangedCells.clear();
+    reachStamps.assign(cellCount, 0);
+    reachStamp = 0;
+    reachUpdatedCells.clear();
+    for (auto& bucket : reachBuckets)
+    {
+        bucket.clear();
+    }
+    reachSources.assign(cellCount, false);
+    
+    guessingChangedCells.clear();
+    guessingChangedCellsValid = false;
+    guessingCellsInRange.clear();
+    hypothesisStamps.assign(cellCount, 0);
+    hypothesisStamp = 0;
+    hypothesisQueue.clear();
+    
+    connectivityOrder.assign(cellCount, 0);
+    connectivityOrderBase = 0;
+    connectivityLow.assign(cellCount, 0);
+    connectivityBlackBelow.assign(cellCount, 0);
+    connectivityStack.clear();
+    connectivityStack.reserve(cellCount);
+    // A region's neighbours are next to its cells so the neighbours on the stack never add up to more than four per cell
+    connectivityAdjacency.clear();
+    connectivityAdjacency.reserve(4 * cellCount);
+    blackConnectivityDirty = true;
+    
+    // The cached completions are kept for their storage, an entry without any cells never matches a region
+    for (auto& completion : islandCompletions)
+    {
+        completion.cells.clear();
+        completion.types.clear();
+    }
+    islandStamps.assign(cellCount, 0);
+    islandStamp = 0;
+    islandBits.assign(cellCount, -2);
+    islandCellChanges.assign(cellCount, 0);
+    islandChangeCount = 0;
+    islandCompletionDirty = true;
+    
+    probingDirty = true;
+    probing = false;
+    probeTypes.assign(cellCount, Cell::Type::Unknown);
+    probeStamps.assign(cellCount, 0);
+    probeStamp = 0;
+    
+    propagateChanges.clear();
+    trail.clear();
+    recordingTrail = false;
+    clueCellIndices.clear();
+    lastSearchStats = SearchStats();
+    lastSolveStats = SolveStats();
+    // Puzzles of different sizes start from different hashes so that their states don't collide in a shared table
+    zobristHash = zobristKey(-1, aWidth * 65536 + aHeight);
 }
 
 void Grid::loadGrid(const string& numbers)
@@ -32,7 +152,6 @@ void Grid::loadGrid(const string& numbers)
         while (*i == ' ')
         {
             auto coord = coordinateFromIterator(i, numbers);
-            rows[coord.y][coord.x].coordinate = coord;
             unknownCellCoords.insert(coord);
             ++i;
             if (i == numbers.cend())
@@ -45,32 +164,65 @@ void Grid::loadGrid(const string& numbers)
             break;
         }
         
-        // parse out the number - note that we support only one digit for the number
+        // parse out the number - note that we support only one digit for the number, loadClues takes bigger numbers
         auto number = *i-48;
-        auto coord = coordinateFromIterator(i, numbers);
-        
-        totalBlackCells -= number;
-        maxRegionSize = max(maxRegionSize, number);
-        
-        //TODO: Consider using move constructor
-        rows[coord.y][coord.x].coordinate = coord;
-        rows[coord.y][coord.x].type = Cell::Type::Numbered;
-        rows[coord.y][coord.x].number = number;
-        rows[coord.y][coord.x].region = shared_ptr<Region>(new Region(Region::Type::Numbered));
-        rows[coord.y][coord.x].region->addCell(rows[coord.y][coord.x]);
-        auto newAdjacentUnknownCells = cellCoordinatesAdjacentTo(Cell::CoordinateTypePair(coord, Cell::Type::Unknown));
-        rows[coord.y][coord.x].region->adjacentUnknownCells.insert(newAdjacentUnknownCells.cbegin(), newAdjacentUnknownCells.cend());
-        regions.insert(rows[coord.y][coord.x].region);
-        
-        numberOfKnownCells++;
+        addClue(indexForCoordinate(coordinateFromIterator(i, numbers)), number);
         i++;
     }
 }
 
-//TODO: Switch to lambdas
-vector<Grid::Cell::CoordinateTypePair> debugOutputHelper(vector<Grid::Cell::CoordinateTypePair>(Grid::*function)(), Grid& grid, const string& message)
+void Grid::loadClues(const vector<Clue>& clues)
+{
+    for (const auto& clue : clues)
+    {
+        addClue(clue.index, clue.number);
+    }
+    
+    // Every cell is visited in order so each insert goes at the end of the set
+    for (int index = 0; index < width * height; index++)
+    {
+        if (cellTypes[index] == Cell::Type::Unknown) { unknownCellCoords.insert(unknownCellCoords.cend(), coordinateForIndex(index)); }
+    }
+}
+
+uint64_t Grid::zobristKey(int cellIndex, int value)
+{
+    // splitmix64 of the cell and value gives every pair its own well mixed key without storing a table of keys
+    uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(cellIndex)) << 32 | static_cast<uint32_t>(value)) + 0x9e3779b97f4a7c15ULL;
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+void Grid::addClue(int index, int number)
+{
+    const auto coord = coordinateForIndex(index);
+    totalBlackCells -= number;
+    maxRegionSize = max(maxRegionSize, number);
+    
+    // Every numbered cell starts out as the root of its own region
+    const int regionId = index;
+    cellTypes[index] = Cell::Type::Numbered;
+    cellNumbers[index] = number;
+    unknownCells.reset(coord.x, coord.y);
+    whiteCells.set(coord.x, coord.y);
+    regionParents[index] = regionId;
+    regionPool[regionId].reset(Region::Type::Numbered);
+    clueCellIndices.push_back(index);
+    zobristHash ^= zobristKey(index, number + 2);
+    
+    auto& region = regionPool[regionId];
+    region.addCell(index, Cell::Type::Numbered, number);
+    forEachNeighbour(index, Cell::Type::Unknown, [this, &region] (int adjacentIndex) {
+        region.adjacentUnknownCells.insert(coordinateForIndex(adjacentIndex));
+    });
+    regions.insert(regionId);
+    
+    numberOfKnownCells++;
+}
+
+void debugOutputHelper(const vector<Grid::Cell::CoordinateTypePair>& changes, Grid& grid, const char* message)
 {
-    vector<Grid::Cell::CoordinateTypePair> changes = (grid.*function)();
 #ifdef DEBUG
     if (!changes.empty())
     {
@@ -82,570 +234,1726 @@ vector<Grid::Cell::CoordinateTypePair> debugOutputHelper(vector<Grid::Cell::Coor
         cout << endl;
         cout << "Known Cells: " << grid.numberOfKnownCells << endl << grid << endl;
     }
+#else
+    (void)changes;
+    (void)grid;
+    (void)message;
 #endif
-    return changes;
 }
 
-void Grid::solve(const vector<Grid::Cell::CoordinateTypePair>& cellsToMark = vector<Grid::Cell::CoordinateTypePair>())
+void Grid::WorkQueue::reset(int capacity)
+{
+    items.clear();
+    items.reserve(capacity);
+    queued.assign(capacity, false);
+    head = 0;
+}
+
+void Grid::WorkQueue::push(int index)
+{
+    if (queued[index]) { return; }
+    queued[index] = true;
+    items.push_back(index);
+}
+
+void Grid::WorkQueue::clear()
+{
+    for (size_t i = head; i < items.size(); i++)
+    {
+        queued[items[i]] = false;
+    }
+    items.clear();
+    head = 0;
+}
+
+int Grid::WorkQueue::pop()
 {
-    if (!cellsToMark.empty())
+    const int index = items[head++];
+    queued[index] = false;
+    
+    // Once everything has been popped start reusing the storage from the front again
+    if (head == items.size())
     {
-        markCells(cellsToMark);
+        items.clear();
+        head = 0;
     }
     
-    //TODO: Am I doing any undeed copies here?
-    auto&& changes = debugOutputHelper(&Grid::applyRuleCompleteRegions, *this, "Complete Regions Rule Made Changes");
-    if (!changes.empty()) solve(changes);
+    return index;
+}
 
-    changes = debugOutputHelper(&Grid::applyRuleMutipleAdjacency, *this, "Adjacency Rule Made Changes");
-    if (!changes.empty()) solve(changes);
+Grid::Result Grid::solve()
+{
+    lastSolveStats = SolveStats();
+    
+    // A malformed puzzle can be broken before any rule runs e.g. two numbers next to each other or a number with no room to grow
+    for (auto clueIndex : clueCellIndices)
+    {
+        forEachNeighbour(clueIndex, Cell::Type::Numbered, [this] (int) { contradiction = true; });
+        // A grid rebuilt from a snapshot can already have merged the clue into a bigger region
+        checkRegion(regionForCell(clueIndex));
+    }
+    
+    // Every rule has to look at everything once, after that the rules only look at what markCell queues for them
+    for (auto regionId : regions)
+    {
+        queueRegion(regionId);
+    }
+    for (auto coord : unknownCellCoords)
+    {
+        multipleAdjacencyQueue.push(indexForCoordinate(coord));
+    }
+    elbowDirty = true;
+    unreachableDirty = true;
+    guessingUnreachableDirty = true;
+    blackConnectivityDirty = true;
+    islandCompletionDirty = true;
+    probingDirty = true;
+    
+    if (!contradiction) { propagate(); }
+    #ifdef DEBUG
+    cout << "Known Cells: " << this->numberOfKnownCells << endl << *this << endl;
+    #endif
+    
+    if (contradiction) { return Result::Contradiction; }
+    return unknownCellCoords.empty() ? Result::Solved : Result::Stuck;
+}
 
-    changes = debugOutputHelper(&Grid::applyRuleElbow, *this, "Elbow Rule Made Changes");
-    if (!changes.empty()) solve(changes);
+void Grid::propagate()
+{
+    auto& changes = propagateChanges;
+    long productiveInvocations = 0;
+    lastSolveStats.propagations++;
+    
+    while (true)
+    {
+        changes.clear();
+        const char* message = nullptr;
+        Rule rule;
+        const auto start = chrono::steady_clock::now();
+        
+        // Always pick the first rule that has work queued so the cheap rules run to a fixpoint before the expensive ones get a look in
+        if (!completeRegionsQueue.empty())
+        {
+            rule = Rule::CompleteRegions;
+            applyRuleCompleteRegions(regionForCell(completeRegionsQueue.pop()), changes);
+            message = "Complete Regions Rule Made Changes";
+        }
+        else if (!multipleAdjacencyQueue.empty())
+        {
+            rule = Rule::MultipleAdjacency;
+            applyRuleMutipleAdjacency(multipleAdjacencyQueue.pop(), changes);
+            message = "Adjacency Rule Made Changes";
+        }
+        else if (elbowDirty)
+        {
+            rule = Rule::Elbow;
+            elbowDirty = false;
+            applyRuleElbow(changes);
+            message = "Elbow Rule Made Changes";
+        }
+        else if (!singlePathwayBlackQueue.empty())
+        {
+            rule = Rule::SinglePathwayBlack;
+            applyRuleSinglePathwayBlack(regionForCell(singlePathwayBlackQueue.pop()), changes);
+            message = "Black Pathway Rule Made Changes";
+        }
+        else if (!singlePathwayWhiteQueue.empty())
+        {
+            rule = Rule::SinglePathwayWhite;
+            applyRuleSinglePathwayWhite(regionForCell(singlePathwayWhiteQueue.pop()), changes);
+            message = "White Pathway Rule Made Changes";
+        }
+        else if (!n1Queue.empty())
+        {
+            rule = Rule::N1;
+            applyRuleN1(regionForCell(n1Queue.pop()), changes);
+            message = "N-1 Rule Made Changes";
+        }
+        else if (unreachableDirty)
+        {
+            rule = Rule::Unreachable;
+            unreachableDirty = false;
+            applyRuleUnreachable(changes);
+            message = "Unreachable Rule Made Changes";
+        }
+        else if (guessingUnreachableDirty)
+        {
+            rule = Rule::GuessingUnreachable;
+            guessingUnreachableDirty = false;
+            applyRuleGuessingUnreachable(changes);
+            message = "Guessing Unreachable Rule Made Changes";
+        }
+        else if (blackConnectivityDirty)
+        {
+            rule = Rule::BlackConnectivity;
+            blackConnectivityDirty = false;
+            applyRuleBlackConnectivity(changes);
+            message = "Black Connectivity Rule Made Changes";
+        }
+        else if (islandCompletionDirty)
+        {
+            rule = Rule::IslandCompletion;
+            islandCompletionDirty = false;
+            applyRuleIslandCompletion(changes);
+            message = "Island Completion Rule Made Changes";
+        }
+        else if (probingDirty && probingEnabled && !probing)
+        {
+            rule = Rule::Probing;
+            probingDirty = false;
+            applyRuleProbing(changes);
+            message = "Probing Made Changes";
+        }
+        else
+        {
+            // Nothing is queued and nothing has changed since the unreachable rules last ran so we have reached a fixpoint
+            break;
+        }
+        
+        debugOutputHelper(changes, *this, message);
+        const long knownCellsBefore = numberOfKnownCells;
+        markCells(changes);
+        
+        // Marking is counted as part of the rule's time because that is where the cost of a deduction ends up
+        auto& ruleStats = lastSolveStats[rule];
+        ruleStats.invocations++;
+        ruleStats.nanoseconds += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        if (numberOfKnownCells != knownCellsBefore)
+        {
+            ruleStats.productiveInvocations++;
+            ruleStats.cellsMarked += numberOfKnownCells - knownCellsBefore;
+            productiveInvocations++;
+            lastSolveStats.maxPropagationDepth = max(lastSolveStats.maxPropagationDepth, productiveInvocations);
+        }
+        
+        // A guess that led to conflicting deductions is about to be undone so there is no point running the rest of the rules
+        if (contradiction) { break; }
+    }
+}
 
-    changes = debugOutputHelper(&Grid::applyRuleSinglePathwayBlack, *this, "Black Pathway Rule Made Changes");
-    if (!changes.empty()) solve(changes);
+void Grid::queueRegion(int regionId)
+{
+    switch (regionPool[regionId].type) {
+        case Region::Type::Numbered:
+            completeRegionsQueue.push(regionId);
+            singlePathwayWhiteQueue.push(regionId);
+            n1Queue.push(regionId);
+            break;
+            
+        case Region::Type::White:
+            singlePathwayWhiteQueue.push(regionId);
+            break;
+            
+        case Region::Type::Black:
+            singlePathwayBlackQueue.push(regionId);
+            break;
+    }
+}
 
-    changes = debugOutputHelper(&Grid::applyRuleSinglePathwayWhite, *this, "White Pathway Rule Made Changes");
-    if (!changes.empty()) solve(changes);
+string Grid::cellString() const
+{
+    string cells(cellTypes.size(), 'U');
+    for (size_t index = 0; index < cellTypes.size(); index++)
+    {
+        switch (cellTypes[index]) {
+            case Cell::Type::Black:
+                cells[index] = 'B';
+                break;
+                
+            case Cell::Type::White:
+            case Cell::Type::Numbered:
+                cells[index] = 'W';
+                break;
+                
+            default:
+                break;
+        }
+    }
+    return cells;
+}
+
+namespace
+{
+    /// Moves bit i of a 32 bit value to bit 2 * i
+    uint64_t spreadBits(uint64_t bits)
+    {
+        bits &= 0xffffffffULL;
+        bits = (bits | (bits << 16)) & 0x0000ffff0000ffffULL;
+        bits = (bits | (bits << 8)) & 0x00ff00ff00ff00ffULL;
+        bits = (bits | (bits << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        bits = (bits | (bits << 2)) & 0x3333333333333333ULL;
+        bits = (bits | (bits << 1)) & 0x5555555555555555ULL;
+        return bits;
+    }
     
-    changes = debugOutputHelper(&Grid::applyRuleN1, *this, "N-1 Rule Made Changes");
-    if (!changes.empty()) solve(changes);
+    /// The inverse of spreadBits, moves bit 2 * i to bit i and drops the odd bits
+    uint64_t compactBits(uint64_t bits)
+    {
+        bits &= 0x5555555555555555ULL;
+        bits = (bits | (bits >> 1)) & 0x3333333333333333ULL;
+        bits = (bits | (bits >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+        bits = (bits | (bits >> 4)) & 0x00ff00ff00ff00ffULL;
+        bits = (bits | (bits >> 8)) & 0x0000ffff0000ffffULL;
+        bits = (bits | (bits >> 16)) & 0x00000000ffffffffULL;
+        return bits;
+    }
+}
+
+void Grid::saveSnapshot(GridSnapshot& snapshot) const
+{
+    snapshot.clear(width, height);
+    for (auto clueIndex : clueCellIndices)
+    {
+        snapshot.clues.push_back(Clue { clueIndex, cellNumbers[clueIndex] });
+    }
+    sort(snapshot.clues.begin(), snapshot.clues.end(), [] (const Clue& lhs, const Clue& rhs) { return lhs.index < rhs.index; });
     
-    changes = debugOutputHelper(&Grid::applyRuleUnreachable, *this, "Unreachable Rule Made Changes");
-    if (!changes.empty()) solve(changes);
+    // Every 64 bit bitboard word becomes two snapshot words, the white bit of a cell is its low bit and the black bit its high bit
+    for (int y = 0; y < height; y++)
+    {
+        for (int i = 0; i < snapshot.wordsPerRow; i++)
+        {
+            const int bitboardIndex = y * blackCells.wordsPerRow + i / 2;
+            const int shift = (i % 2) * 32;
+            const uint64_t white = whiteCells.words[bitboardIndex] >> shift;
+            const uint64_t black = blackCells.words[bitboardIndex] >> shift;
+            snapshot.words[y * snapshot.wordsPerRow + i] = spreadBits(white) | (spreadBits(black) << 1);
+        }
+    }
+}
+
+void Grid::loadSnapshot(const GridSnapshot& snapshot)
+{
+    reset(snapshot.width, snapshot.height);
+    loadClues(snapshot.clues);
     
-    changes = debugOutputHelper(&Grid::applyRuleGuessingUnreachable, *this, "Guessing Unreachable Rule Made Changes");
-    if (!changes.empty()) solve(changes);
+    for (int y = 0; y < height; y++)
+    {
+        for (int i = 0; i < snapshot.wordsPerRow; i++)
+        {
+            const uint64_t word = snapshot.words[y * snapshot.wordsPerRow + i];
+            const uint64_t white = compactBits(word);
+            const uint64_t black = compactBits(word >> 1);
+            
+            // A cell with both bits set is invalid so marking it twice flags the contradiction
+            for (auto cells : { make_pair(white, Cell::Type::White), make_pair(black, Cell::Type::Black) })
+            {
+                uint64_t bits = cells.first;
+                while (bits != 0)
+                {
+                    const int x = i * 32 + __builtin_ctzll(bits);
+                    bits &= bits - 1;
+                    // Numbered cells are already white
+                    if (cells.second == Cell::Type::White && cellTypes[y * width + x] == Cell::Type::Numbered) { continue; }
+                    markCell(Cell::CoordinateTypePair(Cell::Coordinate(x, y), cells.second));
+                }
+            }
+        }
+    }
 }
 
-void Grid::solve()
+bool Grid::solveWithSearch()
 {
-    solve(vector<Grid::Cell::CoordinateTypePair>());
+    const auto start = chrono::steady_clock::now();
+    lastSearchStats = SearchStats();
+    
+    bool solved = false;
+    switch (solve()) {
+        case Result::Solved:
+            // The root is the only node when the rules finish the grid on their own
+            lastSearchStats.nodes = 1;
+            solved = leafVerifier.verify(*this) == SolutionVerifier::Failure::None;
+            break;
+        case Result::Stuck:
+            recordingTrail = true;
+            solved = search();
+            recordingTrail = false;
+            break;
+        case Result::Contradiction:
+            lastSearchStats.nodes = 1;
+            break;
+    }
+    trail.clear();
+    
+    lastSearchStats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
     #ifdef DEBUG
-    cout << "Known Cells: " << this->numberOfKnownCells << endl << *this << endl;
+    cout << "Search visited " << lastSearchStats.nodes << " nodes (" << lastSearchStats.nodesPerSecond() << " nodes/s)" << endl << *this << endl;
     #endif
+    return solved;
+}
+
+bool Grid::search()
+{
+    lastSearchStats.nodes++;
+    if (contradiction || searchCancelled()) { return false; }
+    if (unknownCellCoords.empty()) { return leafVerifier.verify(*this) == SolutionVerifier::Failure::None; }
+    
+    // Only dead states help here, a state known to lead to a solution still has to be searched to find it
+    if (transpositionTable != nullptr)
+    {
+        lastSearchStats.tableProbes++;
+        if (transpositionTable->lookup(zobristHash) == TranspositionTable::Outcome::Dead)
+        {
+            lastSearchStats.tableHits++;
+            return false;
+        }
+    }
+    
+    const long donationsAtState = searchDonations;
+    const auto guess = branchCell();
+    const Cell::Type guessTypes[] = { guess.type, guess.type == Cell::Type::White ? Cell::Type::Black : Cell::Type::White };
+    const int typeCount = donateBranch(guess.coord, guessTypes[1]) ? 1 : 2;
+    for (int i = 0; i < typeCount; i++)
+    {
+        const size_t trailSize = trail.size();
+        markCell(Cell::CoordinateTypePair(guess.coord, guessTypes[i]));
+        propagate();
+        
+        if (search()) { return true; }
+        
+        undoTo(trailSize);
+        lastSearchStats.backtracks++;
+    }
+    
+    // Part of the search was handed off or stopped early so not finding a solution here doesn't make the state dead
+    const bool complete = searchDonations == donationsAtState && !searchCancelled();
+    if (transpositionTable != nullptr && complete) { transpositionTable->store(zobristHash, TranspositionTable::Outcome::Dead); }
+    return false;
+}
+
+bool Grid::donateBranch(Cell::Coordinate coord, Cell::Type type)
+{
+    if (searchSplit == nullptr || !searchSplit->wantsWork()) { return false; }
+    
+    searchSplit->donate(*this, indexForCoordinate(coord), type == Cell::Type::Black);
+    searchDonations++;
+    return true;
+}
+
+int Grid::countSolutions(int limit)
+{
+    const auto start = chrono::steady_clock::now();
+    lastSearchStats = SearchStats();
+    limit = max(limit, 1);
+    
+    int count = 0;
+    switch (solve()) {
+        case Result::Solved:
+            lastSearchStats.nodes = 1;
+            count = leafVerifier.verify(*this) == SolutionVerifier::Failure::None ? 1 : 0;
+            break;
+        case Result::Stuck:
+            recordingTrail = true;
+            countSolutionsFrom(limit, count);
+            recordingTrail = false;
+            break;
+        case Result::Contradiction:
+            lastSearchStats.nodes = 1;
+            break;
+    }
+    trail.clear();
+    
+    lastSearchStats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    // A table hit can add more solutions than were still needed
+    return min(count, limit);
+}
+
+void Grid::countSolutionsFrom(int limit, int& count)
+{
+    lastSearchStats.nodes++;
+    if (contradiction || searchCancelled()) { return; }
+    if (unknownCellCoords.empty())
+    {
+        if (leafVerifier.verify(*this) == SolutionVerifier::Failure::None) { count++; }
+        return;
+    }
+    
+    if (transpositionTable != nullptr)
+    {
+        lastSearchStats.tableProbes++;
+        const auto entry = transpositionTable->lookupEntry(zobristHash);
+        // A count from a search that stopped early only settles the state when it is enough to reach the limit, otherwise the state is searched again
+        const bool settled = entry.outcome != TranspositionTable::Outcome::ManySolutions || entry.exact || entry.solutions >= limit - count;
+        if (entry.outcome != TranspositionTable::Outcome::Unknown && settled)
+        {
+            lastSearchStats.tableHits++;
+            count += entry.outcome == TranspositionTable::Outcome::Dead ? 0 : entry.outcome == TranspositionTable::Outcome::OneSolution ? 1 : entry.solutions;
+            return;
+        }
+    }
+    
+    const int countAtState = count;
+    const long donationsAtState = searchDonations;
+    const auto guess = branchCell();
+    const Cell::Type guessTypes[] = { guess.type, guess.type == Cell::Type::White ? Cell::Type::Black : Cell::Type::White };
+    const int typeCount = donateBranch(guess.coord, guessTypes[1]) ? 1 : 2;
+    for (int i = 0; i < typeCount; i++)
+    {
+        if (count >= limit) { break; }
+        
+        const size_t trailSize = trail.size();
+        const int countBefore = count;
+        markCell(Cell::CoordinateTypePair(guess.coord, guessTypes[i]));
+        propagate();
+        
+        countSolutionsFrom(limit, count);
+        
+        undoTo(trailSize);
+        if (count == countBefore) { lastSearchStats.backtracks++; }
+    }
+    
+    if (transpositionTable == nullptr) { return; }
+    
+    // A search that stopped at the limit, was split or was cancelled may have missed solutions so it only tells us there are at least as many as it found
+    const int found = count - countAtState;
+    const bool finished = count < limit && searchDonations == donationsAtState && !searchCancelled();
+    if (found >= 2) { transpositionTable->storeSolutions(zobristHash, found, finished); }
+    else if (finished) { transpositionTable->store(zobristHash, found == 0 ? TranspositionTable::Outcome::Dead : TranspositionTable::Outcome::OneSolution); }
+}
+
+Grid::Cell::CoordinateTypePair Grid::branchCell() const
+{
+    // Islands with the fewest ways to grow have the fewest options so guess there first, guessing white grows the island
+    // If every island is complete the black regions still have to join up so guess black around the most constrained one
+    int bestWhiteRegionId = -1;
+    int bestBlackRegionId = -1;
+    for (auto regionId : regions)
+    {
+        const auto& region = regionPool[regionId];
+        if (region.adjacentUnknownCells.empty()) { continue; }
+        
+        if (region.type == Region::Type::Black)
+        {
+            if (bestBlackRegionId == -1 || region.adjacentUnknownCells.size() < regionPool[bestBlackRegionId].adjacentUnknownCells.size())
+            {
+                bestBlackRegionId = regionId;
+            }
+        }
+        else if (!region.isComplete())
+        {
+            if (bestWhiteRegionId == -1 || region.adjacentUnknownCells.size() < regionPool[bestWhiteRegionId].adjacentUnknownCells.size())
+            {
+                bestWhiteRegionId = regionId;
+            }
+        }
+    }
+    
+    if (bestWhiteRegionId != -1)
+    {
+        return Cell::CoordinateTypePair(*regionPool[bestWhiteRegionId].adjacentUnknownCells.cbegin(), Cell::Type::White);
+    }
+    if (bestBlackRegionId != -1)
+    {
+        return Cell::CoordinateTypePair(*regionPool[bestBlackRegionId].adjacentUnknownCells.cbegin(), Cell::Type::Black);
+    }
+    return Cell::CoordinateTypePair(*unknownCellCoords.cbegin(), Cell::Type::Black);
 }
 
-vector<Grid::Cell::CoordinateTypePair> Grid::applyRuleCompleteRegions()
+void Grid::recordRegionFields(int regionId)
 {
-    // Set so that we don't mark any duplicates 
-    auto coordsToMarkSet = set<Grid::Cell::CoordinateTypePair>();
-    for (const auto& region : regions)
+    if (!recordingTrail) { return; }
+    
+    const auto& region = regionPool[regionId];
+    auto entry = TrailEntry(TrailEntry::Kind::RegionFields, regionId, -1);
+    entry.regionType = region.type;
+    entry.size = region.size;
+    entry.totalSize = region.totalSize;
+    entry.clueIndex = region.clueIndex;
+    trail.push_back(entry);
+}
+
+bool Grid::probeCells(const vector<int>& cellIndices, vector<ForcedCell>& forced)
+{
+    // Probing undoes its changes through the trail so it has to be recorded even outside of a search
+    const bool wasRecordingTrail = recordingTrail;
+    recordingTrail = true;
+    probing = true;
+    
+    bool consistent = true;
+    for (auto cellIndex : cellIndices)
     {
-        // TODO: If you guess one cell is black and then it makes an adjacent cell unreachable then the first cell is white
-        // -> This is actually only for blocks of 4 cells and it is based on the no pools rule
-        if (region->isComplete())
+        if (cellTypes[cellIndex] != Cell::Type::Unknown) { continue; }
+        
+        probeStamp++;
+        bool failed[2] = { false, false };
+        const Cell::Type probeTypesToTry[] = { Cell::Type::Black, Cell::Type::White };
+        // Once black has failed the cell is white and the rules will work out what that implies, there is nothing to compare against
+        for (int i = 0; i < 2 && !failed[0]; i++)
         {
-            for (auto i = region->adjacentUnknownCells.cbegin(); i != region->adjacentUnknownCells.cend(); ++i)
+            const size_t trailSize = trail.size();
+            markCell(Cell::CoordinateTypePair(coordinateForIndex(cellIndex), probeTypesToTry[i]));
+            propagate();
+            failed[i] = contradiction;
+            
+            // The first entry is the probed cell itself, every other marked cell is a consequence of the probe
+            for (size_t t = trailSize + 1; !failed[i] && t < trail.size(); t++)
+            {
+                if (trail[t].kind != TrailEntry::Kind::MarkCell) { continue; }
+                
+                const int markedIndex = trail[t].cellIndex;
+                if (i == 0)
+                {
+                    probeStamps[markedIndex] = probeStamp;
+                    probeTypes[markedIndex] = cellTypes[markedIndex];
+                }
+                else if (!failed[0] && probeStamps[markedIndex] == probeStamp && probeTypes[markedIndex] == cellTypes[markedIndex])
+                {
+                    forced.push_back(ForcedCell { markedIndex, cellTypes[markedIndex] == Cell::Type::Black });
+                }
+            }
+            
+            undoTo(trailSize);
+        }
+        
+        if (failed[0] && failed[1])
+        {
+            consistent = false;
+            break;
+        }
+        if (failed[0] || failed[1]) { forced.push_back(ForcedCell { cellIndex, failed[1] }); }
+    }
+    
+    recordingTrail = wasRecordingTrail;
+    probing = false;
+    return consistent;
+}
+
+void Grid::applyRuleProbing(vector<Cell::CoordinateTypePair>& changes)
+{
+    probeCellIndices.clear();
+    for (auto coord : unknownCellCoords)
+    {
+        probeCellIndices.push_back(indexForCoordinate(coord));
+    }
+    
+    probeForcedCells.clear();
+    const bool consistent = probeSplit != nullptr ? probeSplit->probe(*this, probeCellIndices, probeForcedCells) : probeCells(probeCellIndices, probeForcedCells);
+    // changes is the buffer propagate shares with the propagations the probes ran, a probe that hit a contradiction leaves its last deductions in it
+    changes.clear();
+    if (!consistent)
+    {
+        contradiction = true;
+        return;
+    }
+    
+    for (const auto& forcedCell : probeForcedCells)
+    {
+        changes.push_back(Cell::CoordinateTypePair(coordinateForIndex(forcedCell.index), forcedCell.black ? Cell::Type::Black : Cell::Type::White));
+    }
+}
+
+void Grid::undoTo(size_t trailSize)
+{
+    while (trail.size() > trailSize)
+    {
+        const auto entry = trail.back();
+        trail.pop_back();
+        
+        switch (entry.kind) {
+            case TrailEntry::Kind::MarkCell:
             {
-                coordsToMarkSet.insert(Cell::CoordinateTypePair(*i, Cell::Type::Black));
+                const auto coord = coordinateForIndex(entry.cellIndex);
+                (cellTypes[entry.cellIndex] == Cell::Type::Black ? blackCells : whiteCells).reset(coord.x, coord.y);
+                zobristHash ^= zobristKey(entry.cellIndex, static_cast<int>(cellTypes[entry.cellIndex]));
+                unknownCells.set(coord.x, coord.y);
+                cellTypes[entry.cellIndex] = Cell::Type::Unknown;
+                islandCellChanges[entry.cellIndex] = ++islandChangeCount;
+                regionParents[entry.cellIndex] = -1;
+                unknownCellCoords.insert(coord);
+                numberOfKnownCells--;
+                break;
+            }
+                
+            case TrailEntry::Kind::CreateRegion:
+                regions.erase(entry.regionId);
+                break;
+                
+            case TrailEntry::Kind::MergeRegions:
+                if (entry.swappedFrontiers)
+                {
+                    regionPool[entry.regionId].adjacentUnknownCells.swap(regionPool[entry.cellIndex].adjacentUnknownCells);
+                }
+                regionParents[entry.cellIndex] = entry.cellIndex;
+                regions.insert(entry.cellIndex);
+                break;
+                
+            case TrailEntry::Kind::RegionFields:
+            {
+                auto& region = regionPool[entry.regionId];
+                region.type = entry.regionType;
+                region.size = entry.size;
+                region.totalSize = entry.totalSize;
+                region.clueIndex = entry.clueIndex;
+                break;
             }
+                
+            case TrailEntry::Kind::FrontierInsert:
+                regionPool[entry.regionId].adjacentUnknownCells.erase(coordinateForIndex(entry.cellIndex));
+                break;
+                
+            case TrailEntry::Kind::FrontierErase:
+                regionPool[entry.regionId].adjacentUnknownCells.insert(coordinateForIndex(entry.cellIndex));
+                break;
         }
     }
     
-    return vector<Grid::Cell::CoordinateTypePair>(coordsToMarkSet.cbegin(), coordsToMarkSet.cend());
+    // We only ever undo back to a state that the rules had already finished with
+    for (auto queue : { &completeRegionsQueue, &multipleAdjacencyQueue, &singlePathwayBlackQueue, &singlePathwayWhiteQueue, &n1Queue, &guessingWindowQueue })
+    {
+        queue->clear();
+    }
+    elbowDirty = false;
+    unreachableDirty = false;
+    guessingUnreachableDirty = false;
+    blackConnectivityDirty = false;
+    islandCompletionDirty = false;
+    probingDirty = false;
+    contradiction = false;
+    
+    // The budgets are cheaper to recompute than to record
+    reachBudgetsValid = false;
+    reachChangedCells.clear();
+    guessingChangedCellsValid = false;
+    guessingChangedCells.clear();
 }
 
-vector<Grid::Cell::CoordinateTypePair> Grid::applyRuleMutipleAdjacency()
+void Grid::applyRuleCompleteRegions(int regionId, vector<Cell::CoordinateTypePair>& changes)
 {
-    auto coordsToMark = vector<Cell::CoordinateTypePair>();
-    for (auto i = unknownCellCoords.cbegin(); i != unknownCellCoords.cend(); ++i)
+    const auto& region = regionPool[regionId];
+    // TODO: If you guess one cell is black and then it makes an adjacent cell unreachable then the first cell is white
+    // -> This is actually only for blocks of 4 cells and it is based on the no pools rule
+    if (region.type == Region::Type::Numbered && region.isComplete())
     {
-        auto adjacentCellCoords = cellCoordinatesAdjacentTo(*i);
+        for (auto i = region.adjacentUnknownCells.cbegin(); i != region.adjacentUnknownCells.cend(); ++i)
+        {
+            changes.push_back(Cell::CoordinateTypePair(*i, Cell::Type::Black));
+        }
+    }
+}
+
+void Grid::applyRuleMutipleAdjacency(int cellIndex, vector<Cell::CoordinateTypePair>& changes)
+{
+    if (cellTypes[cellIndex] != Cell::Type::Unknown) { return; }
+    
+    // Two adjacent cells can belong to the same region so only count each region once
+    int incompleteNumberedRegionIds[4];
+    int incompleteWhiteRegionCount = 0;
+    for (auto adjacentIndex : neighbours(cellIndex))
+    {
+        const int regionId = regionForCell(adjacentIndex);
         
-        int incompleteWhiteRegionCount = 0;
-        for (auto i = adjacentCellCoords.cbegin(); i != adjacentCellCoords.cend(); ++i)
+        if (regionId != -1 &&
+            !regionPool[regionId].isComplete() &&
+            regionPool[regionId].type == Region::Type::Numbered &&
+            find(incompleteNumberedRegionIds, incompleteNumberedRegionIds + incompleteWhiteRegionCount, regionId) == incompleteNumberedRegionIds + incompleteWhiteRegionCount)
+        {
+            incompleteNumberedRegionIds[incompleteWhiteRegionCount++] = regionId;
+        }
+    }
+    
+    if (incompleteWhiteRegionCount >= 2)
+    {
+        changes.push_back(Cell::CoordinateTypePair(coordinateForIndex(cellIndex), Cell::Type::Black));
+    }
+}
+
+void Grid::applyRuleElbow(vector<Cell::CoordinateTypePair>& changes)
+{
+    // An elbow is a 2x2 window with three black cells, the fourth cell is the one in the curve of the elbow
+    BitboardKernels::findElbowWindows(blackCells, unknownCells, matchedWindows);
+    matchedWindows.forEach([this, &changes] (int x, int y) {
+        const int windowIndex = y * width + x;
+        for (auto cellIndex : { windowIndex, windowIndex + 1, windowIndex + width, windowIndex + width + 1 })
+        {
+            if (cellTypes[cellIndex] == Cell::Type::Unknown)
+            {
+                changes.push_back(Cell::CoordinateTypePair(coordinateForIndex(cellIndex), Cell::Type::White));
+            }
+        }
+    });
+}
+
+//TODO: These two rules are almost exactly the same we can combine them
+void Grid::applyRuleSinglePathwayWhite(int regionId, vector<Cell::CoordinateTypePair>& changes)
+{
+    // I need to look for all incomplete white regions and see if there is a single pathway out or not
+    const auto& region = regionPool[regionId];
+    // If the region is white it is by definition incomplete because it is not connected to it's numbered 'parent' region
+    // We only want to apply this rule to incomplete regions
+    if (region.type == Region::Type::Black) { return; }
+    if (region.type == Region::Type::Numbered && region.isComplete()) { return; }
+    
+    if (region.adjacentUnknownCells.size() == 1)
+    {
+        changes.push_back(Cell::CoordinateTypePair(*region.adjacentUnknownCells.cbegin(), Cell::Type::White));
+    }
+}
+
+void Grid::applyRuleSinglePathwayBlack(int regionId, vector<Cell::CoordinateTypePair>& changes)
+{
+    // I need to check all black regions and see if there is a single pathway out or not
+    const auto& region = regionPool[regionId];
+    if (region.type != Region::Type::Black) { return; }
+    
+    // If this region already holds every black cell in the solution it doesn't need a way out
+    if (region.size >= totalBlackCells) { return; }
+    
+    // We have a black region, do we only have one possible path out of the black region?
+    if (region.adjacentUnknownCells.size() == 1)
+    {
+        // We do! So we can mark this cell as black
+        changes.push_back(Cell::CoordinateTypePair(*region.adjacentUnknownCells.cbegin(), Cell::Type::Black));
+    }
+}
+
+bool Grid::areCoordinatesDiagonal(Cell::Coordinate one, Cell::Coordinate two) const
+{
+    return abs(one.x - two.x) == 1 && abs(one.y - two.y) == 1;
+}
+
+template <typename Visitor>
+void Grid::withGeometry(Visitor visitor)
+{
+    // The sizes most puzzles come in, anything else takes the runtime path
+    if (!fixedGeometryEnabled) { visitor(RuntimeGeometry { width, height }); }
+    else if (width == 7 && height == 7) { visitor(FixedGeometry<7, 7>()); }
+    else if (width == 10 && height == 10) { visitor(FixedGeometry<10, 10>()); }
+    else if (width == 15 && height == 15) { visitor(FixedGeometry<15, 15>()); }
+    else if (width == 20 && height == 20) { visitor(FixedGeometry<20, 20>()); }
+    else { visitor(RuntimeGeometry { width, height }); }
+}
+
+template <typename Geometry, typename Visitor>
+void Grid::forEachNeighbour(const Geometry& geometry, int cellIndex, Visitor visitor)
+{
+    const int x = cellIndex % geometry.width;
+    const int y = cellIndex / geometry.width;
+    if (y + 1 < geometry.height) { visitor(cellIndex + geometry.width); }
+    if (y > 0) { visitor(cellIndex - geometry.width); }
+    if (x > 0) { visitor(cellIndex - 1); }
+    if (x + 1 < geometry.width) { visitor(cellIndex + 1); }
+}
+
+void Grid::applyRuleUnreachable(vector<Cell::CoordinateTypePair>& changes)
+{
+    // If there is no valid path from any numbered region to the unknown cell then that unknown cell is unreachable and must be black
+    // Cells whose budget wasn't recomputed were already swept on an earlier pass
+    withGeometry([this] (const auto& geometry) { updateReachBudgets(geometry, reachUpdatedCells); });
+    for (auto cellIndex : reachUpdatedCells)
+    {
+        if (cellTypes[cellIndex] == Cell::Type::Unknown && reachBudgets[cellIndex] < 1)
+        {
+            changes.push_back(Cell::CoordinateTypePair(coordinateForIndex(cellIndex), Cell::Type::Black));
+        }
+    }
+}
+
+int Grid::sourceReachBudget(int cellIndex, bool& isSource) const
+{
+    // A cell has at most four neighbours so the regions fit in a fixed array
+    int adjacentRegionIds[4];
+    int adjacentRegionCount = 0;
+    for (auto adjacentIndex : neighbours(cellIndex))
+    {
+        const int regionId = regionForCell(adjacentIndex);
+        if (regionId == -1 || regionPool[regionId].type == Region::Type::Black) { continue; }
+        
+        // Two adjacent cells can belong to the same region, each region should only be counted once
+        if (find(adjacentRegionIds, adjacentRegionIds + adjacentRegionCount, regionId) == adjacentRegionIds + adjacentRegionCount)
+        {
+            adjacentRegionIds[adjacentRegionCount++] = regionId;
+        }
+    }
+    
+    isSource = adjacentRegionCount > 0;
+    if (!isSource) { return 0; }
+    
+    int mergedWhiteRegionSize = 0;
+    int numberedRegionId = -1;
+    for (int i = 0; i < adjacentRegionCount; i++)
+    {
+        const int regionId = adjacentRegionIds[i];
+        const auto& region = regionPool[regionId];
+        if (region.type == Region::Type::Numbered)
+        {
+            // A cell next to two numbered regions can never be white
+            if (numberedRegionId != -1) { return 0; }
+            numberedRegionId = regionId;
+        }
+        mergedWhiteRegionSize += region.size;
+    }
+    
+    // Joining a white region that doesn't have a number yet still has to leave room for at least the numbered cell
+    const int budget = numberedRegionId != -1 ?
+        regionPool[numberedRegionId].totalSize - mergedWhiteRegionSize :
+        maxRegionSize - 1 - mergedWhiteRegionSize;
+    return max(budget, 0);
+}
+
+template <typename Geometry>
+void Grid::updateReachBudgets(const Geometry& geometry, vector<int>& updatedCells)
+{
+    if (!reachBudgetsValid)
+    {
+        updatedCells.clear();
+        reachStamp++;
+        for (int i = 0; i < geometry.width * geometry.height; i++)
+        {
+            reachStamps[i] = reachStamp;
+            updatedCells.push_back(i);
+        }
+    }
+    else
+    {
+        collectCellsInReachRange(geometry, reachChangedCells, updatedCells);
+    }
+    reachChangedCells.clear();
+    reachBudgetsValid = true;
+    
+    // Seed the buckets with the budget of every source in range and whatever the cells just out of range can pass in
+    reachBuckets.resize(maxRegionSize + 1);
+    for (auto cellIndex : updatedCells)
+    {
+        reachBudgets[cellIndex] = 0;
+        reachSources[cellIndex] = false;
+    }
+    for (auto cellIndex : updatedCells)
+    {
+        if (cellTypes[cellIndex] != Cell::Type::Unknown) { continue; }
+        
+        bool isSource;
+        const int budget = sourceReachBudget(cellIndex, isSource);
+        reachSources[cellIndex] = isSource;
+        if (isSource)
+        {
+            reachBudgets[cellIndex] = budget;
+            reachBuckets[budget].push_back(cellIndex);
+            continue;
+        }
+        
+        forEachNeighbour(geometry, cellIndex, [this, cellIndex] (int adjacentIndex) {
+            if (cellTypes[adjacentIndex] == Cell::Type::Unknown && reachStamps[adjacentIndex] != reachStamp && reachBudgets[adjacentIndex] - 1 > reachBudgets[cellIndex])
+            {
+                reachBudgets[cellIndex] = reachBudgets[adjacentIndex] - 1;
+            }
+        });
+        reachBuckets[reachBudgets[cellIndex]].push_back(cellIndex);
+    }
+    
+    // Pass budgets on from the largest down, a cell is only final once its bucket is reached so stale bucket entries are skipped
+    // Only cells that don't touch a white or numbered region take a budget from a neighbour, a path can't go through a cell that would join an island
+    for (int budget = maxRegionSize; budget >= 0; budget--)
+    {
+        auto& bucket = reachBuckets[budget];
+        for (size_t i = 0; i < bucket.size(); i++)
+        {
+            const int cellIndex = bucket[i];
+            if (reachBudgets[cellIndex] != budget || budget < 2) { continue; }
+            
+            forEachNeighbour(geometry, cellIndex, [this, budget] (int adjacentIndex) {
+                if (cellTypes[adjacentIndex] != Cell::Type::Unknown || reachStamps[adjacentIndex] != reachStamp || reachSources[adjacentIndex] || reachBudgets[adjacentIndex] >= budget - 1) { return; }
+                
+                reachBudgets[adjacentIndex] = budget - 1;
+                reachBuckets[budget - 1].push_back(adjacentIndex);
+            });
+        }
+        bucket.clear();
+    }
+}
+
+template <typename Geometry>
+void Grid::collectCellsInReachRange(const Geometry& geometry, const vector<int>& changedCells, vector<int>& cellsInRange)
+{
+    cellsInRange.clear();
+    reachStamp++;
+    
+    // The search ignores cell types because the range is a bound on distance not on paths
+    const int range = 2 * maxRegionSize + 1;
+    for (auto cellIndex : changedCells)
+    {
+        if (reachStamps[cellIndex] == reachStamp) { continue; }
+        reachStamps[cellIndex] = reachStamp;
+        cellsInRange.push_back(cellIndex);
+    }
+    size_t levelStart = 0;
+    for (int distance = 0; distance < range && levelStart < cellsInRange.size(); distance++)
+    {
+        const size_t levelEnd = cellsInRange.size();
+        for (size_t i = levelStart; i < levelEnd; i++)
+        {
+            forEachNeighbour(geometry, cellsInRange[i], [this, &cellsInRange] (int adjacentIndex) {
+                if (reachStamps[adjacentIndex] == reachStamp) { return; }
+                reachStamps[adjacentIndex] = reachStamp;
+                cellsInRange.push_back(adjacentIndex);
+            });
+        }
+        levelStart = levelEnd;
+    }
+}
+
+template <typename Geometry>
+bool Grid::unreachableWithBlackCell(const Geometry& geometry, int cellIndex, int blackCellIndex)
+{
+    hypothesisStamp++;
+    hypothesisStamps[blackCellIndex] = hypothesisStamp;
+    hypothesisStamps[cellIndex] = hypothesisStamp;
+    hypothesisQueue.clear();
+    hypothesisQueue.push_back(make_pair(cellIndex, 1));
+    
+    for (size_t i = 0; i < hypothesisQueue.size(); i++)
+    {
+        // pathLength counts the unknown cells from the starting cell up to and including this one
+        const int nodeIndex = hypothesisQueue[i].first;
+        const int pathLength = hypothesisQueue[i].second;
+        
+        // A source's budget doesn't depend on any other unknown cell, for everything else the budget is the best any path through the cell could do
+        if (reachBudgets[nodeIndex] < pathLength) { continue; }
+        if (reachSources[nodeIndex]) { return false; }
+        
+        forEachNeighbour(geometry, nodeIndex, [this, pathLength] (int adjacentIndex) {
+            if (cellTypes[adjacentIndex] != Cell::Type::Unknown || hypothesisStamps[adjacentIndex] == hypothesisStamp) { return; }
+            hypothesisStamps[adjacentIndex] = hypothesisStamp;
+            hypothesisQueue.push_back(make_pair(adjacentIndex, pathLength + 1));
+        });
+    }
+    
+    return true;
+}
+
+// This is basically a variation on the pool rule, pools are not allowed so if marking one cell in a 4 cell block as black
+// makes the only other cell in that 4 cell block black then it must be white because otherwise we would have a pool
+void Grid::applyRuleGuessingUnreachable(vector<Cell::CoordinateTypePair>& changes)
+{
+    // The hypothesis checks lean on the reach budgets so let the unreachable rule bring them up to date first
+    if (!reachBudgetsValid || !reachChangedCells.empty())
+    {
+        unreachableDirty = true;
+        guessingUnreachableDirty = true;
+        return;
+    }
+    
+    withGeometry([this, &changes] (const auto& geometry) { applyRuleGuessingUnreachable(geometry, changes); });
+}
+
+template <typename Geometry>
+void Grid::applyRuleGuessingUnreachable(const Geometry& geometry, vector<Cell::CoordinateTypePair>& changes)
+{
+    const int width = geometry.width;
+    const int height = geometry.height;
+    
+    if (!guessingChangedCellsValid)
+    {
+        for (int y = 0; y < height - 1; y++)
+        {
+            for (int x = 0; x < width - 1; x++)
+            {
+                guessingWindowQueue.push(y * width + x);
+            }
+        }
+    }
+    else
+    {
+        // Queue every window that contains a cell in range of a change
+        collectCellsInReachRange(geometry, guessingChangedCells, guessingCellsInRange);
+        for (auto cellIndex : guessingCellsInRange)
+        {
+            const int cellX = cellIndex % width;
+            const int cellY = cellIndex / width;
+            for (int y = max(cellY - 1, 0); y <= min(cellY, height - 2); y++)
+            {
+                for (int x = max(cellX - 1, 0); x <= min(cellX, width - 2); x++)
+                {
+                    guessingWindowQueue.push(y * width + x);
+                }
+            }
+        }
+    }
+    guessingChangedCells.clear();
+    guessingChangedCellsValid = true;
+    
+    // We are checking for the case that we have two black cells and two unknown cells in the window, the kernel finds every such window on the grid at once
+    BitboardKernels::findPoolCandidateWindows(blackCells, whiteCells, matchedWindows);
+    while (!guessingWindowQueue.empty())
+    {
+        const int windowIndex = guessingWindowQueue.pop();
+        if (!matchedWindows.test(windowIndex % width, windowIndex / width)) { continue; }
+        
+        int unknownIndices[2];
+        int unknownCount = 0;
+        for (auto cellIndex : { windowIndex, windowIndex + 1, windowIndex + width, windowIndex + width + 1 })
+        {
+            if (cellTypes[cellIndex] == Cell::Type::Unknown) { unknownIndices[unknownCount++] = cellIndex; }
+        }
+        
+        // First try marking the first cell black and then test the second for unreachability
+        if (unreachableWithBlackCell(geometry, unknownIndices[1], unknownIndices[0]))
+        {
+            // If setting the first cell as black made the second unreachable then we need to set the first white
+            changes.push_back(Cell::CoordinateTypePair(coordinateForIndex(unknownIndices[0]), Cell::Type::White));
+        }
+        
+        if (unreachableWithBlackCell(geometry, unknownIndices[0], unknownIndices[1]))
+        {
+            changes.push_back(Cell::CoordinateTypePair(coordinateForIndex(unknownIndices[1]), Cell::Type::White));
+        }
+    }
+}
+
+void Grid::pushConnectivityNode(int node, int order)
+{
+    connectivityOrder[node] = connectivityLow[node] = order;
+    
+    // Each node takes its slice of the shared neighbour stack so the search never allocates
+    ConnectivityFrame frame;
+    frame.node = node;
+    frame.begin = frame.next = static_cast<int>(connectivityAdjacency.size());
+    if (cellTypes[node] == Cell::Type::Black)
+    {
+        connectivityBlackBelow[node] = regionPool[node].size;
+        for (const auto& coord : regionPool[node].adjacentUnknownCells)
         {
-            const auto& cellAtCoord = rows[i->y][i->x];
-            
-            if (cellAtCoord.region != nullptr &&
-                !cellAtCoord.region->isComplete() &&
-                cellAtCoord.region->type == Region::Type::Numbered)
-            {
-                incompleteWhiteRegionCount++;
-            }
+            connectivityAdjacency.push_back(indexForCoordinate(coord));
         }
-        
-        if (incompleteWhiteRegionCount >= 2)
+    }
+    else
+    {
+        connectivityBlackBelow[node] = 0;
+        for (auto adjacentIndex : neighbours(node))
         {
-            coordsToMark.push_back(Cell::CoordinateTypePair(*i, Cell::Type::Black));
+            const auto adjacentType = cellTypes[adjacentIndex];
+            if (adjacentType == Cell::Type::Unknown) { connectivityAdjacency.push_back(adjacentIndex); }
+            else if (adjacentType == Cell::Type::Black) { connectivityAdjacency.push_back(regionForCell(adjacentIndex)); }
         }
     }
-    
-    return coordsToMark;
+    connectivityStack.push_back(frame);
 }
 
-/// Returns the coordinate of the cell to change white based on the elbow rule
-///
-///     - Parameters:
-///         - coord: The coordinate of black cell to use as the center of the elbow for testing the elbow rule
-Grid::Cell::Coordinate Grid::coordinateToChangeWhiteBasedOnElbowRule(Cell::Coordinate coord) const
+void Grid::applyRuleBlackConnectivity(vector<Cell::CoordinateTypePair>& changes)
 {
-    Cell::Coordinate upCoord = Cell::Coordinate(coord.x, coord.y + 1);
-    Cell::Coordinate leftCoord = Cell::Coordinate(coord.x - 1, coord.y);
-    Cell::Coordinate downCoord = Cell::Coordinate(coord.x, coord.y - 1);
-    Cell::Coordinate rightCoord = Cell::Coordinate(coord.x + 1, coord.y);
-    
-    auto checkCoords = [this] (Cell::Coordinate one, Cell::Coordinate two, Cell::Coordinate toMark) {
-        return isCoordinateInBounds(one) &&
-        isCoordinateInBounds(two) &&
-        cellForCoordinate(one).type == Cell::Type::Black &&
-        cellForCoordinate(two).type == Cell::Type::Black &&
-        cellForCoordinate(toMark).type == Cell::Type::Unknown;
-    };
-    
-    // check if we have an 'up left' opening elbow
-    auto coordToMark = Cell::Coordinate(coord.x - 1, coord.y + 1);
-    if (checkCoords(upCoord, leftCoord, coordToMark))
+    // The bitboards give the number of cells the search should reach and the first black cell without looking at every cell
+    int rootIndex = -1;
+    int blackCellCount = 0;
+    int unknownCellCount = 0;
+    for (int y = 0; y < height; y++)
     {
-        return coordToMark;
+        for (int i = 0; i < blackCells.wordsPerRow; i++)
+        {
+            const uint64_t black = blackCells.words[y * blackCells.wordsPerRow + i];
+            if (rootIndex == -1 && black != 0) { rootIndex = y * width + i * 64 + __builtin_ctzll(black); }
+            blackCellCount += __builtin_popcountll(black);
+            unknownCellCount += __builtin_popcountll(unknownCells.words[y * unknownCells.wordsPerRow + i]);
+        }
     }
+    if (rootIndex == -1) { return; }
     
-    // check if we have an 'up right' opening elbow
-    coordToMark = Cell::Coordinate(coord.x + 1, coord.y + 1);
-    if (checkCoords(upCoord, rightCoord, coordToMark))
+    // Orders from earlier searches are all at most the base so the orders don't have to be cleared between searches
+    const int cellCount = width * height;
+    if (connectivityOrderBase > numeric_limits<int>::max() - cellCount)
     {
-        return coordToMark;
+        fill(connectivityOrder.begin(), connectivityOrder.end(), 0);
+        connectivityOrderBase = 0;
     }
+    const int base = connectivityOrderBase;
+    int order = base;
+    int reachedUnknownCells = 0;
     
-    // check if we have a 'down left' opening elbow
-    coordToMark = Cell::Coordinate(coord.x - 1, coord.y - 1);
-    if (checkCoords(downCoord, leftCoord, coordToMark))
+    // The search runs over unknown cells and whole black regions, the root is black so it never has to be checked as an articulation point
+    rootIndex = regionForCell(rootIndex);
+    connectivityStack.clear();
+    connectivityAdjacency.clear();
+    pushConnectivityNode(rootIndex, ++order);
+    while (!connectivityStack.empty())
     {
-        return coordToMark;
+        // Carry on through the neighbours of the node on top of the stack until one of them hasn't been reached yet
+        auto& frame = connectivityStack.back();
+        const int node = frame.node;
+        int nodeLow = connectivityLow[node];
+        int adjacentNode = -1;
+        while (frame.next < static_cast<int>(connectivityAdjacency.size()))
+        {
+            const int index = connectivityAdjacency[frame.next++];
+            if (connectivityOrder[index] <= base)
+            {
+                adjacentNode = index;
+                break;
+            }
+            // Going back to the parent gives the same minimum as the tree edge so it doesn't have to be excluded
+            nodeLow = min(nodeLow, connectivityOrder[index]);
+        }
+        connectivityLow[node] = nodeLow;
+        
+        if (adjacentNode != -1)
+        {
+            if (cellTypes[adjacentNode] == Cell::Type::Unknown) { reachedUnknownCells++; }
+            pushConnectivityNode(adjacentNode, ++order);
+            continue;
+        }
+        
+        connectivityAdjacency.resize(frame.begin);
+        connectivityStack.pop_back();
+        if (connectivityStack.empty()) { break; }
+        
+        const int parentNode = connectivityStack.back().node;
+        connectivityLow[parentNode] = min(connectivityLow[parentNode], connectivityLow[node]);
+        connectivityBlackBelow[parentNode] += connectivityBlackBelow[node];
+        // Nothing below this node reaches above the parent so without the parent the black cells below are cut off from the root
+        if (connectivityLow[node] >= connectivityOrder[parentNode] && connectivityBlackBelow[node] > 0 && cellTypes[parentNode] == Cell::Type::Unknown)
+        {
+            changes.push_back(Cell::CoordinateTypePair(coordinateForIndex(parentNode), Cell::Type::Black));
+        }
     }
+    connectivityOrderBase = order;
     
-    // check if we have a 'down right' opening elbow
-    coordToMark = Cell::Coordinate(coord.x + 1, coord.y - 1);
-    if (checkCoords(downCoord, rightCoord, coordToMark))
+    if (connectivityBlackBelow[rootIndex] < blackCellCount)
     {
-        return coordToMark;
+        contradiction = true;
+        return;
     }
+    if (reachedUnknownCells == unknownCellCount) { return; }
     
-    return Cell::Coordinate(UINT8_MAX, UINT8_MAX);
-}
-
-vector<Grid::Cell::CoordinateTypePair> Grid::applyRuleElbow()
-{
-    auto coordsToMark = vector<Cell::CoordinateTypePair>();
-    for (auto i = blackCellCoords.cbegin(); i != blackCellCoords.cend(); ++i)
+    for (int i = 0; i < cellCount; i++)
     {
-        auto coordToChangeWhite = coordinateToChangeWhiteBasedOnElbowRule(*i);
-        if (isCoordinateInBounds(coordToChangeWhite))
+        if (connectivityOrder[i] <= base && cellTypes[i] == Cell::Type::Unknown)
         {
-            coordsToMark.push_back(Cell::CoordinateTypePair(coordToChangeWhite, Cell::Type::White));
+            changes.push_back(Cell::CoordinateTypePair(coordinateForIndex(i), Cell::Type::White));
         }
     }
-    return coordsToMark;
 }
 
-//TODO: These two rules are almost exactly the same we can combine them
-vector<Grid::Cell::CoordinateTypePair> Grid::applyRuleSinglePathwayWhite()
+void Grid::applyRuleIslandCompletion(vector<Cell::CoordinateTypePair>& changes)
 {
-    // I need to look for all incomplete white regions and see if there is a single pathway out or not
-    auto coordsToMarkSet = set<Grid::Cell::CoordinateTypePair>();
-    for (auto i = regions.cbegin(); i != regions.cend(); ++i)
+    if (islandCompletions.size() < clueCellIndices.size()) { islandCompletions.resize(clueCellIndices.size()); }
+    
+    for (size_t i = 0; i < clueCellIndices.size(); i++)
     {
-        const auto& region = **i;
-        // If the region is white it is by definition incomplete because it is not connected to it's numbered 'parent' region
-        // We only want to apply this rule to incomplete regions
-        if (region.type == Region::Type::Black) { continue; }
-        if (region.type == Region::Type::Numbered && region.isComplete()) { continue; }
+        const int clueIndex = clueCellIndices[i];
+        const auto& region = regionPool[regionForCell(clueIndex)];
+        const int cellsLeft = region.totalSize - region.size;
+        if (cellsLeft <= 0 || cellsLeft > islandCompletionMaxCellsLeft) { continue; }
         
-        if (region.adjacentUnknownCells.size() == 1)
+        // Only enumerate again if something the completions depend on has changed since they were last worked out
+        auto& completion = islandCompletions[i];
+        const bool unchanged = !completion.cells.empty() && all_of(completion.cells.cbegin(), completion.cells.cend(), [this, &completion] (int cellIndex) {
+            return islandCellChanges[cellIndex] <= completion.checkedAt;
+        });
+        if (!unchanged)
         {
-            coordsToMarkSet.insert(Cell::CoordinateTypePair(*region.adjacentUnknownCells.cbegin(), Cell::Type::White));
+            const bool fits = collectIslandCells(clueIndex, cellsLeft);
+            if (completion.cells != islandCells || completion.types != islandTypes)
+            {
+                completion.cells = islandCells;
+                completion.types = islandTypes;
+                completion.deductions.clear();
+                completion.contradiction = false;
+                if (fits) { enumerateIslandCompletions(cellsLeft, completion); }
+            }
+            completion.checkedAt = islandChangeCount;
         }
-    }
-    
-    return vector<Cell::CoordinateTypePair>(coordsToMarkSet.cbegin(), coordsToMarkSet.cend());
-}
-
-vector<Grid::Cell::CoordinateTypePair> Grid::applyRuleSinglePathwayBlack()
-{
-    // I need to check all black regions and see if there is a single pathway out or not
-    auto coordsToMarkSet = set<Cell::CoordinateTypePair>();
-    for (auto i = regions.cbegin(); i != regions.cend(); ++i)
-    {
-        const auto& region = **i;
-        if (region.type != Region::Type::Black) { continue; }
         
-        // We have a black region, do we only have one possible path out of the black region?
-        if (region.adjacentUnknownCells.size() == 1)
+        if (completion.contradiction)
+        {
+            contradiction = true;
+            return;
+        }
+        // The deductions can have been made already, either by this rule or another one
+        for (const auto& deduction : completion.deductions)
         {
-            // We do! So we can mark this cell as black
-            // Note that we can't mark the cell here because markCell modifies the regions set on Grid that we are iterating through
-            coordsToMarkSet.insert(Cell::CoordinateTypePair(*region.adjacentUnknownCells.cbegin(), Cell::Type::Black));
+            if (typeForCoordinate(deduction.coord) == Cell::Type::Unknown) { changes.push_back(deduction); }
         }
     }
-    
-    return vector<Cell::CoordinateTypePair>(coordsToMarkSet.cbegin(), coordsToMarkSet.cend());
-}
-
-bool Grid::areCoordinatesDiagonal(Cell::Coordinate one, Cell::Coordinate two) const
-{
-    return abs(one.x - two.x) == 1 && abs(one.y - two.y) == 1;
 }
 
-bool Grid::unreachable(Cell::Coordinate unknownCoord, set<Cell::Coordinate> visitedCoords = set<Cell::Coordinate>()) const
+bool Grid::collectIslandCells(int clueIndex, int cellsLeft)
 {
-    if (rows[unknownCoord.y][unknownCoord.x].type != Cell::Type::Unknown) { abort(); }
-    
-    auto adjacentCells = cellCoordinatesAdjacentTo(unknownCoord);
-    auto adjacentNumberedRegions = vector<shared_ptr<Region>>();
-    auto adjacentWhiteRegions = vector<shared_ptr<Region>>();
-    
-    auto nodesToVisit = queue<pair<Cell::Coordinate, uint8_t>>();
+    const int regionId = regionForCell(clueIndex);
+    islandStamp++;
+    islandCells.clear();
+    islandTypes.clear();
+    islandDistances.clear();
+    islandBitCells.clear();
     
-    nodesToVisit.push(pair<Cell::Coordinate, uint8_t>(unknownCoord, 1));
+    auto collect = [this] (int cellIndex, int distance, int bit) {
+        islandStamps[cellIndex] = islandStamp;
+        islandBits[cellIndex] = bit;
+        islandCells.push_back(cellIndex);
+        islandTypes.push_back(cellTypes[cellIndex]);
+        islandDistances.push_back(distance);
+    };
     
-    while (!nodesToVisit.empty())
+    // The region's own cells are the white cells joined to the clue
+    collect(clueIndex, 0, -1);
+    for (size_t i = 0; i < islandCells.size(); i++)
     {
-        // Grab the next node off of the queue
-        pair<Cell::Coordinate, uint8_t> node = nodesToVisit.front();
-        
-        // Mark the node as visited
-        nodesToVisit.pop();
-        visitedCoords.insert(node.first);
-        
-        // We need to determine if we should visit this nodes adjacent cells
-        auto adjacentCells = cellCoordinatesAdjacentTo(node.first);
-        auto adjacentRegions = vector<shared_ptr<Region>>();
-        transform(adjacentCells.cbegin(), adjacentCells.cend(), back_inserter(adjacentRegions), [this] (Cell::Coordinate coord) {
-            return rows[coord.y][coord.x].region;
-        });
-        
-        auto adjacentNumberedRegions = vector<shared_ptr<Region>>();
-        copy_if(adjacentRegions.cbegin(), adjacentRegions.cend(), back_inserter(adjacentNumberedRegions), [] (shared_ptr<Region> regionPtr) -> bool {
-            return regionPtr != nullptr && regionPtr->type == Region::Type::Numbered;
-        });
-        
-        auto adjacentWhiteRegions = vector<shared_ptr<Region>>();
-        copy_if(adjacentRegions.cbegin(), adjacentRegions.cend(), back_inserter(adjacentWhiteRegions), [] (shared_ptr<Region> regionPtr) -> bool {
-            return regionPtr != nullptr && regionPtr->type == Region::Type::White;
-        });
-        
-        uint8_t mergedWhiteRegionSize = 0;
-        for (auto whiteRegion : adjacentWhiteRegions)
+        for (auto adjacentIndex : neighbours(islandCells[i]))
         {
-            mergedWhiteRegionSize += whiteRegion->size;
+            const auto adjacentType = cellTypes[adjacentIndex];
+            if (islandStamps[adjacentIndex] == islandStamp || (adjacentType != Cell::Type::White && adjacentType != Cell::Type::Numbered)) { continue; }
+            if (regionForCell(adjacentIndex) == regionId) { collect(adjacentIndex, 0, -1); }
         }
+    }
+    islandRegionSize = static_cast<int>(islandCells.size());
+    
+    // Then breadth first out from the region through unknown and white cells as far as the cells left to place allow. A white cell that already belongs to another number leads back to
+    // that number, which is never a cell the region can grow into, so every completion that takes it in fails for having a white cell next to it and ownership doesn't need tracking here
+    for (size_t i = 0; i < islandCells.size(); i++)
+    {
+        if (islandDistances[i] == cellsLeft) { continue; }
         
-        for (auto numberedRegion : adjacentNumberedRegions)
+        for (auto adjacentIndex : neighbours(islandCells[i]))
         {
-            mergedWhiteRegionSize += numberedRegion->size;
-        }
-        
-        // If this cell is adjacent to two or more numbered regions we cannot add its adjacent cells to the list of cells to visit
-        if (adjacentNumberedRegions.size() > 1) {
-            continue;
-        }
-        
-        if (adjacentNumberedRegions.size() == 1) {
-            const int num = (*adjacentNumberedRegions.begin())->totalSize;
+            if (islandStamps[adjacentIndex] == islandStamp) { continue; }
             
-            if (node.second + mergedWhiteRegionSize <= num) {
-                return false;
-            } else {
-                continue;
-            }
-        }
-        
-        // If we encounter a white region we need to check to see if the current size is less than the largest possible white region - 1
-        // If it is then we have found a potentially valid path so return false, if visiting the cell would create a white region
-        // that is larger than the largest possible white region then continue - we can't visit this node
-        if (!adjacentWhiteRegions.empty()) {
-            if (node.second + mergedWhiteRegionSize + 1 > maxRegionSize) {
-                continue;
-            } else {
-                return false;
+            const auto adjacentType = cellTypes[adjacentIndex];
+            if (adjacentType == Cell::Type::Unknown || adjacentType == Cell::Type::White)
+            {
+                collect(adjacentIndex, islandDistances[i] + 1, static_cast<int>(islandBitCells.size()));
+                islandBitCells.push_back(adjacentIndex);
             }
         }
-        
-        // If we haven't hit any of the control flow breaks above then we need to add all unknown unvisited cells to the list of cells to visit
-        for (auto unknownAdjacentCoord : cellCoordinatesAdjacentTo(Cell::CoordinateTypePair(node.first, Cell::Type::Unknown)))
+    }
+    islandCandidateCount = static_cast<int>(islandCells.size()) - islandRegionSize;
+    
+    // Finally every cell next to the region or a cell it can grow into, only the unknown ones can be deduced so only they get bits
+    const size_t candidateEnd = islandCells.size();
+    for (size_t i = 0; i < candidateEnd; i++)
+    {
+        for (auto adjacentIndex : neighbours(islandCells[i]))
         {
-            if (visitedCoords.find(unknownAdjacentCoord) == visitedCoords.end())
+            if (islandStamps[adjacentIndex] == islandStamp) { continue; }
+            
+            if (cellTypes[adjacentIndex] == Cell::Type::Unknown)
             {
-                nodesToVisit.push(pair<Cell::Coordinate, uint8_t>(unknownAdjacentCoord, node.second+1));
+                collect(adjacentIndex, -1, static_cast<int>(islandBitCells.size()));
+                islandBitCells.push_back(adjacentIndex);
+            }
+            else
+            {
+                collect(adjacentIndex, -1, -2);
             }
         }
     }
     
-    return true;
+    return islandBitCells.size() <= 64;
 }
 
-vector<Grid::Cell::CoordinateTypePair> Grid::applyRuleUnreachable()
+void Grid::enumerateIslandCompletions(int cellsLeft, IslandCompletion& completion)
 {
-    auto coordsToMark = vector<Cell::CoordinateTypePair>();
+    islandAdjacent.assign(islandCandidateCount, 0);
+    islandWhiteAdjacent.assign(islandCandidateCount, 0);
+    islandBorder.assign(islandCandidateCount, 0);
+    const uint64_t candidates = islandCandidateCount == 64 ? ~uint64_t(0) : (uint64_t(1) << islandCandidateCount) - 1;
+    uint64_t allowed = candidates;
+    uint64_t regionAdjacent = 0;
+    islandRegionBorder = 0;
     
-    // For each unknown cell we need to do a breadth first search to find if a path exists from an unknown cell to a region
-    // If there is no valid path from any numbered region to the unknown cell then that unknown cell is unreachable and must be black
-    for (auto unknownCellCoord : unknownCellCoords)
+    for (int i = 0; i < islandRegionSize + islandCandidateCount; i++)
     {
-        if (unreachable(unknownCellCoord))
+        const int bit = i - islandRegionSize;
+        for (auto adjacentIndex : neighbours(islandCells[i]))
         {
-            coordsToMark.push_back(Cell::CoordinateTypePair(unknownCellCoord, Cell::Type::Black));
+            const int adjacentBit = islandBits[adjacentIndex];
+            const auto adjacentType = cellTypes[adjacentIndex];
+            if (adjacentBit == -1) { continue; }
+            if (adjacentBit == -2)
+            {
+                // A white cell that the island can't take in would join it and make it too big
+                if (bit >= 0 && (adjacentType == Cell::Type::White || adjacentType == Cell::Type::Numbered)) { allowed &= ~(uint64_t(1) << bit); }
+                continue;
+            }
+            
+            const uint64_t adjacentMask = uint64_t(1) << adjacentBit;
+            if (bit < 0)
+            {
+                if (adjacentType == Cell::Type::Unknown) { islandRegionBorder |= adjacentMask; }
+                regionAdjacent |= adjacentMask & candidates;
+                continue;
+            }
+            if (adjacentType == Cell::Type::Unknown) { islandBorder[bit] |= adjacentMask; }
+            else { islandWhiteAdjacent[bit] |= adjacentMask; }
+            islandAdjacent[bit] |= adjacentMask & candidates;
         }
     }
-    return coordsToMark;
+    for (auto& adjacent : islandAdjacent)
+    {
+        adjacent &= allowed;
+    }
+    
+    islandInEvery = ~uint64_t(0);
+    islandBorderOfEvery = ~uint64_t(0);
+    islandCompletionCount = 0;
+    islandSteps = 0;
+    const uint64_t untried = regionAdjacent & allowed;
+    extendIsland(0, untried, untried, cellsLeft);
+    
+    // Giving up part way through means some completions were never seen so nothing can be deduced
+    if (islandSteps > islandCompletionMaxSteps) { return; }
+    if (islandCompletionCount == 0)
+    {
+        completion.contradiction = true;
+        return;
+    }
+    
+    for (uint64_t cells = islandInEvery & candidates; cells != 0; cells &= cells - 1)
+    {
+        const int cellIndex = islandBitCells[__builtin_ctzll(cells)];
+        if (cellTypes[cellIndex] == Cell::Type::Unknown) { completion.deductions.push_back(Cell::CoordinateTypePair(coordinateForIndex(cellIndex), Cell::Type::White)); }
+    }
+    for (uint64_t cells = islandBorderOfEvery; cells != 0; cells &= cells - 1)
+    {
+        completion.deductions.push_back(Cell::CoordinateTypePair(coordinateForIndex(islandBitCells[__builtin_ctzll(cells)]), Cell::Type::Black));
+    }
 }
 
-// This is basically a variation on the pool rule, pools are not allowed so if marking one cell in a 4 cell block as black
-// makes the only other cell in that 4 cell block black then it must be white because otherwise we would have a pool
-vector<Grid::Cell::CoordinateTypePair> Grid::applyRuleGuessingUnreachable()
+void Grid::extendIsland(uint64_t island, uint64_t untried, uint64_t seen, int cellsLeft)
 {
-    auto coordsToMark = vector<Cell::CoordinateTypePair>();
-    
-    for (int i = 0; i < width - 1; i++)
+    while (untried != 0)
     {
-        for (int j = 0; j < height - 1; j++)
+        if (++islandSteps > islandCompletionMaxSteps) { return; }
+        
+        // Once a cell has been tried at this depth the later branches leave it out, that way no set of cells is reached twice
+        const int bit = __builtin_ctzll(untried);
+        untried &= untried - 1;
+        const uint64_t grown = island | (uint64_t(1) << bit);
+        if (cellsLeft > 1)
         {
-            // We need to sample squares of cells, and we are checking for the case that we have two black cells and two unknown cells
-            vector<Cell::Coordinate> squareCoordinates =
-            {
-                Cell::Coordinate(i,     j),
-                Cell::Coordinate(i + 1, j),
-                Cell::Coordinate(i,     j + 1),
-                Cell::Coordinate(i + 1, j + 1),
-            };
-            
-            auto squareTypes = vector<Cell::Type>();
-            auto unknownCoords = vector<Cell::Coordinate>();
-            transform(squareCoordinates.cbegin(), squareCoordinates.cend(), back_inserter(squareTypes), [this] (Cell::Coordinate coord) {
-                return rows[coord.y][coord.x].type;
-            });
-            copy_if(squareCoordinates.cbegin(), squareCoordinates.cend(), back_inserter(unknownCoords), [this] (Cell::Coordinate coord) {
-                return rows[coord.y][coord.x].type == Cell::Type::Unknown;
-            });
-            
-            int blackCount = 0;
-            int unknownCount = 0;
-            for (auto type : squareTypes)
-            {
-                if (type == Cell::Type::Black)
-                {
-                    blackCount++;
-                }
-                else if (type == Cell::Type::Unknown)
-                {
-                    unknownCount++;
-                }
-            }
-            
-            if (blackCount == 2 && unknownCount == 2)
+            const uint64_t added = islandAdjacent[bit] & ~seen;
+            extendIsland(grown, untried | added, seen | added, cellsLeft - 1);
+            continue;
+        }
+        
+        // A white cell next to the finished island would join it, otherwise every unknown cell around it has to be black
+        uint64_t border = islandRegionBorder;
+        bool valid = true;
+        for (uint64_t cells = grown; cells != 0; cells &= cells - 1)
+        {
+            const int cellBit = __builtin_ctzll(cells);
+            if ((islandWhiteAdjacent[cellBit] & ~grown) != 0)
             {
-                // First try marking the first coordinate black and then test the second for unreachability
-                auto firstUnknownCoord = unknownCoords.front();
-                auto secondUnknownCoord = unknownCoords.back();
-                if (unreachable(secondUnknownCoord, set<Cell::Coordinate>{ firstUnknownCoord }))
-                {
-                    // If setting the first coordinate as black made the second unreachable then we need to set the first white
-                    coordsToMark.push_back(Cell::CoordinateTypePair(firstUnknownCoord, Cell::Type::White));
-                }
-                
-                if (unreachable(firstUnknownCoord, set<Cell::Coordinate>{ secondUnknownCoord }))
-                {
-                    coordsToMark.push_back(Cell::CoordinateTypePair(secondUnknownCoord, Cell::Type::White));
-                }
+                valid = false;
+                break;
             }
+            border |= islandBorder[cellBit];
         }
+        if (!valid) { continue; }
+        
+        islandCompletionCount++;
+        islandInEvery &= grown;
+        islandBorderOfEvery &= border & ~grown;
     }
-    return coordsToMark;
 }
 
-vector<Grid::Cell::CoordinateTypePair> Grid::applyRuleN1()
+void Grid::applyRuleN1(int regionId, vector<Cell::CoordinateTypePair>& changes)
 {
-    auto coordsToMark = vector<Cell::CoordinateTypePair>();
-    for (auto i = regions.cbegin(); i != regions.cend(); ++i)
+    const auto& region = regionPool[regionId];
+    if (region.type != Region::Type::Numbered) { return; }
+    
+    // we have a numbered region, do we only have two possible pathways out and have we marked N-1 cells white?
+    if (region.adjacentUnknownCells.size() == 2 && region.size == region.totalSize-1)
     {
-        const auto& region = **i;
-        if (region.type != Region::Type::Numbered) { continue; }
+        auto firstCoord = *region.adjacentUnknownCells.cbegin();
+        auto secondCoord = *++region.adjacentUnknownCells.cbegin();
         
-        // we have a numbered region, do we only have two possible pathways out and have we marked N-1 cells white?
-        if (region.adjacentUnknownCells.size() == 2 && region.size == region.totalSize-1)
+        if (areCoordinatesDiagonal(firstCoord, secondCoord))
         {
-            auto firstCoord = *region.adjacentUnknownCells.cbegin();
-            auto secondCoord = *++region.adjacentUnknownCells.cbegin();
-            
-            if (areCoordinatesDiagonal(firstCoord, secondCoord))
+            // We have only two possible pathways and they are diagonal from eachother - we can mark the cell
+            // We mark the cell that is adjacent to both unknown cells and is also unknown
+            // The first cell is above the second so the two cells that touch both are the corners of their 2x2 window, in coordinate order
+            const Cell::Coordinate adjacentToBoth[] = { Cell::Coordinate(secondCoord.x, firstCoord.y), Cell::Coordinate(firstCoord.x, secondCoord.y) };
+            for (auto coord : adjacentToBoth)
             {
-                // We have only two possible pathways and they are diagonal from eachother - we can mark the cell
-                // We mark the cell that is adjacent to both unknown cells and is also unknown
-                auto firstAdjacentCells = cellCoordinatesAdjacentTo(firstCoord);
-                auto secondAdjacentCells = cellCoordinatesAdjacentTo(secondCoord);
-                sort(firstAdjacentCells.begin(), firstAdjacentCells.end());
-                sort(secondAdjacentCells.begin(), secondAdjacentCells.end());
-                auto adjacentToBoth = vector<Cell::Coordinate>();
-                set_intersection(firstAdjacentCells.cbegin(), firstAdjacentCells.cend(),
-                                 secondAdjacentCells.cbegin(), secondAdjacentCells.cend(),
-                                 back_inserter(adjacentToBoth));
-                
-                for (auto coord : adjacentToBoth)
+                if (typeForCoordinate(coord) == Cell::Type::Unknown)
                 {
-                    if (rows[coord.y][coord.x].type == Cell::Type::Unknown)
-                    {
-                        coordsToMark.push_back(Cell::CoordinateTypePair(coord, Cell::Type::Black));
-                    }
+                    changes.push_back(Cell::CoordinateTypePair(coord, Cell::Type::Black));
                 }
             }
         }
     }
-    
-    return coordsToMark;
 }
 
 void Grid::markCell(Cell::CoordinateTypePair pair)
 {
     auto coord = pair.coord;
     auto type = pair.type;
-    if (rows[coord.y][coord.x].type != Cell::Type::Unknown) { abort(); }
+    const int index = indexForCoordinate(coord);
+    if (cellTypes[index] != Cell::Type::Unknown || (type != Cell::Type::White && type != Cell::Type::Black))
+    {
+        // Cells can only be marked once and only as white or black
+        contradiction = true;
+        return;
+    }
     
     // Grid state updates
+    if (recordingTrail) { trail.push_back(TrailEntry(TrailEntry::Kind::MarkCell, -1, index)); }
     unknownCellCoords.erase(coord);
-    if (type == Cell::Type::Black) { blackCellCoords.insert(coord); }
     numberOfKnownCells++;
-    rows[coord.y][coord.x].type = type;
+    lastSolveStats.totalMarks++;
+    cellTypes[index] = type;
+    islandCellChanges[index] = ++islandChangeCount;
+    zobristHash ^= zobristKey(index, static_cast<int>(type));
+    probingDirty = true;
+    unknownCells.reset(coord.x, coord.y);
+    (type == Cell::Type::Black ? blackCells : whiteCells).set(coord.x, coord.y);
     
     // Region State Updates
         
     // First thing we need to do to keep the regions up to date is find all of the adjacent cells that are of the same type - we will need to merge all of these regions
-    vector<Cell::Coordinate> adjacentCellCoords = cellCoordinatesAdjacentTo(coord);
-    auto adjacentTypedCellCoords = vector<Cell::Coordinate>();
-    
-    copy_if(adjacentCellCoords.cbegin(), adjacentCellCoords.cend(), back_inserter(adjacentTypedCellCoords), [this, type] (Cell::Coordinate a) -> bool {
-        if (type == Cell::Type::White)
+    // Every region that touches this cell loses it as an adjacent unknown cell so we keep track of those too to queue them up for the rules
+    auto& adjacentRegionIds = markAdjacentRegionIds;
+    auto& borderingRegionIds = markBorderingRegionIds;
+    adjacentRegionIds.clear();
+    borderingRegionIds.clear();
+    for (auto adjacentIndex : neighbours(index))
+    {
+        const auto adjacentType = cellTypes[adjacentIndex];
+        if (adjacentType != Cell::Type::Unknown)
         {
-            return rows[a.y][a.x].type == Cell::Type::White || rows[a.y][a.x].type == Cell::Type::Numbered;
+            borderingRegionIds.push_back(regionForCell(adjacentIndex));
         }
-        else
+        
+        const bool sameType = type == Cell::Type::White ?
+            adjacentType == Cell::Type::White || adjacentType == Cell::Type::Numbered :
+            adjacentType == Cell::Type::Black;
+        
+        if (sameType)
         {
-            return rows[a.y][a.x].type == Cell::Type::Black;
+            adjacentRegionIds.push_back(regionForCell(adjacentIndex));
         }
-    });
+    }
     
-    shared_ptr<Region> newRegionPtr = nullptr;
-    if (adjacentTypedCellCoords.size() > 1)
+    // Two adjacent cells can already be part of the same region so we only want each region once
+    sort(adjacentRegionIds.begin(), adjacentRegionIds.end());
+    adjacentRegionIds.erase(unique(adjacentRegionIds.begin(), adjacentRegionIds.end()), adjacentRegionIds.end());
+    
+    int newRegionId = -1;
+    if (adjacentRegionIds.size() > 1)
     {
-        // If there are more than 1 adjacent typed cell we need to merge regions
-        auto regionsToMerge = vector<shared_ptr<Region>>();
-        auto coords = adjacentTypedCellCoords;
-        transform(coords.cbegin(), coords.cend(), back_inserter(regionsToMerge), [this] (Cell::Coordinate coord) {
-            return rows[coord.y][coord.x].region;
-        });
-        
-        newRegionPtr = mergeRegions(regionsToMerge);
+        // If there are more than 1 adjacent regions we need to merge them
+        newRegionId = mergeRegions(adjacentRegionIds);
     }
-    else if (adjacentTypedCellCoords.size() == 1)
+    else if (adjacentRegionIds.size() == 1)
     {
-        // If there is only one adjacent typed cell we can just adopt the region as our own
-        auto coord = adjacentTypedCellCoords[0];
-        newRegionPtr = rows[coord.y][coord.x].region;
+        // If there is only one adjacent region we can just adopt the region as our own
+        newRegionId = adjacentRegionIds[0];
     }
     else
     {
         // If there are no adjacent cells that are the same type as the cell that we are adding we need to create a new region
-        Region::Type regionType;
-        switch (type) {
-            case Cell::Type::White:
-                regionType = Region::Type::White;
-                break;
-            case Cell::Type::Black:
-                regionType = Region::Type::Black;
-                break;
-            case Cell::Type::Numbered:
-            case Cell::Type::Unknown:
-                abort();
-        }
+        const auto regionType = type == Cell::Type::White ? Region::Type::White : Region::Type::Black;
         
-        // If the black cell is isolated we need to make a new region
-        newRegionPtr = make_shared<Region>(regionType);
-        regions.insert(newRegionPtr);
+        // If the cell is isolated we need to make a new region with the cell as its root
+        newRegionId = index;
+        regionPool[newRegionId].reset(regionType);
+        regions.insert(newRegionId);
+        if (recordingTrail) { trail.push_back(TrailEntry(TrailEntry::Kind::CreateRegion, newRegionId, index)); }
     }
     
     // After we have the new region (which is either a newly created region or a merge of several regions we add the cell to it
-    newRegionPtr->addCell(rows[coord.y][coord.x]);
-    
-    // Update the cell->shared_ptr<Region> pointer to point to the newly created/merged region
-    rows[coord.y][coord.x].region = newRegionPtr;
+    recordRegionFields(newRegionId);
+    auto& newRegion = regionPool[newRegionId];
+    newRegion.addCell(index, type, cellNumbers[index]);
+    regionParents[index] = newRegionId;
     
     // Update the regions adjacent unknown cell list with the added cells adjacent cells
-    auto newAdjacentUnknownCells = cellCoordinatesAdjacentTo(Cell::CoordinateTypePair(coord, Cell::Type::Unknown));
-    newRegionPtr->adjacentUnknownCells.insert(newAdjacentUnknownCells.cbegin(), newAdjacentUnknownCells.cend());
+    forEachNeighbour(index, Cell::Type::Unknown, [this, &newRegion, newRegionId] (int adjacentIndex) {
+        if (newRegion.adjacentUnknownCells.insert(coordinateForIndex(adjacentIndex)).second && recordingTrail)
+        {
+            trail.push_back(TrailEntry(TrailEntry::Kind::FrontierInsert, newRegionId, adjacentIndex));
+        }
+    });
+    
+    // erase the cell we just marked from the sets of adjacent unknown cells, only the regions bordering the cell can have it in their set so there are at most four
+    // The merge above can have changed the roots of the bordering regions so they are looked up again
+    for (auto& regionId : borderingRegionIds)
+    {
+        regionId = regionForCell(regionId);
+    }
+    sort(borderingRegionIds.begin(), borderingRegionIds.end());
+    borderingRegionIds.erase(unique(borderingRegionIds.begin(), borderingRegionIds.end()), borderingRegionIds.end());
+    for (auto regionId : borderingRegionIds)
+    {
+        auto& region = regionPool[regionId];
+        if (region.adjacentUnknownCells.erase(coord))
+        {
+            if (recordingTrail) { trail.push_back(TrailEntry(TrailEntry::Kind::FrontierErase, regionId, index)); }
+            // Losing an adjacent unknown cell can box the region in
+            if (region.adjacentUnknownCells.empty()) { checkRegion(regionId); }
+        }
+    }
+    checkRegion(newRegionId);
+    
+    // Queue everything around the cell that the rules need to look at again
+    queueRegion(newRegionId);
+    for (auto regionId : borderingRegionIds)
+    {
+        queueRegion(regionId);
+    }
+    
+    if (type == Cell::Type::Black)
+    {
+        // Every 2x2 window that contains this cell could now be an elbow or a pool
+        elbowDirty = true;
+        for (int y = max(coord.y - 1, 0); y <= min((int)coord.y, height - 2); y++)
+        {
+            for (int x = max(coord.x - 1, 0); x <= min((int)coord.x, width - 2); x++)
+            {
+                checkPool(y * width + x);
+            }
+        }
+    }
+    else if (newRegion.type == Region::Type::Numbered)
+    {
+        // The cell could have joined a white region to a numbered region so every unknown cell around the region could now touch a different number
+        for (auto adjacentUnknownCoord : newRegion.adjacentUnknownCells)
+        {
+            multipleAdjacencyQueue.push(indexForCoordinate(adjacentUnknownCoord));
+        }
+    }
     
-    // erase the cell we just marked from every regions set of adjacent unknown cells
-    for (auto i = regions.cbegin(); i != regions.cend(); ++i)
+    if (reachBudgetsValid) { reachChangedCells.push_back(index); }
+    if (guessingChangedCellsValid) { guessingChangedCells.push_back(index); }
+    unreachableDirty = true;
+    guessingUnreachableDirty = true;
+    blackConnectivityDirty = true;
+    islandCompletionDirty = true;
+}
+
+void Grid::checkRegion(int regionId)
+{
+    const auto& region = regionPool[regionId];
+    const bool boxedIn = region.adjacentUnknownCells.empty();
+    switch (region.type) {
+        case Region::Type::Numbered:
+            // Islands can't be bigger than their number and an incomplete island needs room to grow
+            if (region.size > region.totalSize || (boxedIn && !region.isComplete())) { contradiction = true; }
+            break;
+            
+        case Region::Type::White:
+            // A white region without a number has to be able to reach one
+            if (boxedIn) { contradiction = true; }
+            break;
+            
+        case Region::Type::Black:
+            // A black region that can't grow has to already contain every black cell
+            if (region.size > totalBlackCells || (boxedIn && region.size < totalBlackCells)) { contradiction = true; }
+            break;
+    }
+}
+
+void Grid::checkPool(int windowIndex)
+{
+    if (cellTypes[windowIndex] == Cell::Type::Black &&
+        cellTypes[windowIndex + 1] == Cell::Type::Black &&
+        cellTypes[windowIndex + width] == Cell::Type::Black &&
+        cellTypes[windowIndex + width + 1] == Cell::Type::Black)
     {
-        auto& region = **i;
-        region.adjacentUnknownCells.erase(coord);
+        contradiction = true;
     }
 }
 
-void Grid::Region::mergeWith(const Region& region)
+bool Grid::Region::mergeWith(Region& region, vector<Cell::Coordinate>& insertedCells)
 {
-    if (region.type == Region::Type::Black && this->type != Region::Type::Black) { abort(); }
-    if (region.type != Region::Type::Black && this->type == Region::Type::Black) { abort(); }
+    // A white region that absorbs a numbered region becomes a numbered region
+    if (region.type == Region::Type::Numbered) { type = Region::Type::Numbered; }
     
     size += region.size;
     totalSize = max(this->totalSize, region.totalSize);
-    coordinates.insert(region.coordinates.cbegin(), region.coordinates.cend());
-    adjacentUnknownCells.insert(region.adjacentUnknownCells.cbegin(), region.adjacentUnknownCells.cend());
+    clueIndex = max(this->clueIndex, region.clueIndex);
+    
+    // Always insert the smaller set into the larger one, each unknown cell then moves between sets O(log n) times over the whole solve
+    const bool swapped = adjacentUnknownCells.size() < region.adjacentUnknownCells.size();
+    if (swapped)
+    {
+        adjacentUnknownCells.swap(region.adjacentUnknownCells);
+    }
+    
+    for (auto coord : region.adjacentUnknownCells)
+    {
+        if (adjacentUnknownCells.insert(coord).second)
+        {
+            insertedCells.push_back(coord);
+        }
+    }
+    
+    return swapped;
 }
 
-shared_ptr<Grid::Region> Grid::mergeRegions(vector<shared_ptr<Region>>& regionsToMerge)
+int Grid::regionForCell(int cellIndex) const
 {
-    if (regionsToMerge.size() < 2) { abort(); }
+    int parent = regionParents[cellIndex];
     
-    // First sort regions on size
-    sort(regionsToMerge.begin(), regionsToMerge.end());
-
-    // Then iterate through the regions merging the next region with the last
-    auto mergedRegion = *regionsToMerge.begin();
-    for (auto i = regionsToMerge.begin()+1; i != regionsToMerge.end(); ++i)
+    // Path halving: every other node on the way up is pointed at its grandparent
+    // While searching the paths are left alone so that merges can be undone, union by size keeps them short anyway
+    while (parent != cellIndex && parent != -1)
     {
-        shared_ptr<Region> regionToMergePtr = *i;
-        mergedRegion->mergeWith(*regionToMergePtr);
+        const int grandparent = regionParents[parent];
+        if (grandparent != parent && !recordingTrail) { regionParents[cellIndex] = grandparent; }
+        cellIndex = grandparent;
+        parent = regionParents[cellIndex];
+    }
+    
+    return parent;
+}
 
-        // For every cell that was part of region *regionToMergePtr we need to update it's region pointer
-        for(auto cellCoordinateItr = (*i)->coordinates.cbegin(); cellCoordinateItr != (*i)->coordinates.cend(); ++cellCoordinateItr)
+int Grid::mergeRegions(const vector<int>& regionIdsToMerge)
+{
+    if (regionIdsToMerge.size() == 1) { return regionIdsToMerge.front(); }
+    
+    // Every island has exactly one number
+    const auto numberedRegionCount = count_if(regionIdsToMerge.cbegin(), regionIdsToMerge.cend(), [this] (int regionId) {
+        return regionPool[regionId].type == Region::Type::Numbered;
+    });
+    if (numberedRegionCount > 1) { contradiction = true; }
+    
+    int mergedRegionId = regionIdsToMerge.front();
+    for (auto i = regionIdsToMerge.cbegin()+1; i != regionIdsToMerge.cend(); ++i)
+    {
+        // Union by size, the root of the larger region becomes the root of the merged region
+        int absorbedRegionId = *i;
+        if (regionPool[mergedRegionId] < regionPool[absorbedRegionId])
         {
-            rows[cellCoordinateItr->y][cellCoordinateItr->x].region = mergedRegion;
+            swap(mergedRegionId, absorbedRegionId);
         }
         
-        // Finally we need to delete the regions that have been merged into a larger region
-        regions.erase(*i);
+        recordRegionFields(mergedRegionId);
+        mergeInsertedCells.clear();
+        const bool swapped = regionPool[mergedRegionId].mergeWith(regionPool[absorbedRegionId], mergeInsertedCells);
+        regionParents[absorbedRegionId] = mergedRegionId;
+        regions.erase(absorbedRegionId);
+        
+        if (recordingTrail)
+        {
+            auto entry = TrailEntry(TrailEntry::Kind::MergeRegions, mergedRegionId, absorbedRegionId);
+            entry.swappedFrontiers = swapped;
+            trail.push_back(entry);
+            for (auto coord : mergeInsertedCells)
+            {
+                trail.push_back(TrailEntry(TrailEntry::Kind::FrontierInsert, mergedRegionId, indexForCoordinate(coord)));
+            }
+        }
+        else
+        {
+            // Nothing will ever need the absorbed region's set again
+            regionPool[absorbedRegionId].adjacentUnknownCells.clear();
+        }
     }
     
     // return the region that is now a merge of all the regions that were passed in
-    return *regionsToMerge.begin();
+    return mergedRegionId;
 }
 
 void Grid::markCells(const std::vector<Cell::CoordinateTypePair>& cellCoordTypePairs) {
     for (auto i = cellCoordTypePairs.cbegin(); i != cellCoordTypePairs.cend(); ++i)
     {
+        // Several rules can deduce the same cell, numbered cells are white as far as the rules are concerned
+        const auto currentType = typeForCoordinate(i->coord);
+        if (currentType == i->type || (currentType == Cell::Type::Numbered && i->type == Cell::Type::White)) { continue; }
+        
+        // A deduction for a cell that already has the other colour is flagged as a contradiction by markCell, nothing after that is worth marking
         markCell(*i);
+        if (contradiction) { return; }
     }
 }
 
-bool Grid::isCoordinateInBounds(Grid::Cell::Coordinate coord) const
-{
-    if (coord.x < this->width &&
-        coord.x >= 0 &&
-        coord.y < this->height &&
-        coord.y >= 0)
-    {
-        return true;
-    }
-    
-    return false;
-}
-
-const Grid::Cell& Grid::cellForCoordinate(Cell::Coordinate coord) const
-{
-    return rows[coord.y][coord.x];
-}
-
 Grid::Cell::Coordinate Grid::coordinateFromIterator(const string::const_iterator& i, const string& string) const
 {
     long index = (long)(i - string.cbegin()); //TODO: Verify that this is constant time or just track index
@@ -655,81 +1963,63 @@ Grid::Cell::Coordinate Grid::coordinateFromIterator(const string::const_iterator
     return Cell::Coordinate(x, y);
 }
 
-//TODO: Convert this to use visitor pattern
-//TODO: Add helpers to grab adjacent regions
-vector<Grid::Cell::Coordinate> Grid::cellCoordinatesAdjacentTo(Cell::Coordinate coord) const
-{
-    return cellCoordinatesAdjacentTo(rows[coord.y][coord.x]);
-}
-
-vector<Grid::Cell::Coordinate> Grid::cellCoordinatesAdjacentTo(Cell::CoordinateTypePair coordTypePair) const
+void Grid::Region::addCell(int cellIndex, Cell::Type cellType, int number)
 {
-    auto adjacentCells = cellCoordinatesAdjacentTo(coordTypePair.coord);
-    auto typedAdjacentCells = vector<Cell::Coordinate>();
-    copy_if(adjacentCells.cbegin(), adjacentCells.cend(), back_inserter(typedAdjacentCells), [this, coordTypePair] (Cell::Coordinate coord) {
-        return rows[coord.y][coord.x].type == coordTypePair.type;
-    });
-    return typedAdjacentCells;
+    size++;
+    
+    if (cellType == Grid::Cell::Type::Numbered)
+    {
+        totalSize = number;
+        clueIndex = cellIndex;
+    }
 }
 
-vector<Grid::Cell::Coordinate> Grid::cellCoordinatesAdjacentTo(const Cell& cell) const
+const char* Grid::SolveStats::ruleName(Rule rule)
 {
-    auto up = Cell::Coordinate(cell.coordinate.x, cell.coordinate.y+1);
-    auto down = Cell::Coordinate(cell.coordinate.x, cell.coordinate.y-1);
-    auto left = Cell::Coordinate(cell.coordinate.x-1, cell.coordinate.y);
-    auto right = Cell::Coordinate(cell.coordinate.x+1, cell.coordinate.y);
-    
-    auto cells = vector<Cell::Coordinate>();
-    if (isCoordinateInBounds(up)) { cells.push_back( move(up) ); }
-    if (isCoordinateInBounds(down)) { cells.push_back( move(down) ); }
-    if (isCoordinateInBounds(left)) { cells.push_back( move(left) ); }
-    if (isCoordinateInBounds(right)) { cells.push_back( move(right) ); }
-    
-    return cells;
+    switch (rule) {
+        case Rule::CompleteRegions: return "CompleteRegions";
+        case Rule::MultipleAdjacency: return "MultipleAdjacency";
+        case Rule::Elbow: return "Elbow";
+        case Rule::SinglePathwayBlack: return "SinglePathwayBlack";
+        case Rule::SinglePathwayWhite: return "SinglePathwayWhite";
+        case Rule::N1: return "N1";
+        case Rule::Unreachable: return "Unreachable";
+        case Rule::GuessingUnreachable: return "GuessingUnreachable";
+        case Rule::BlackConnectivity: return "BlackConnectivity";
+        case Rule::IslandCompletion: return "IslandCompletion";
+        case Rule::Probing: return "Probing";
+        case Rule::Count: break;
+    }
+    return "Unknown";
 }
 
-void Grid::Region::addCell(const Grid::Cell& cell)
+void Grid::SolveStats::add(const SolveStats& other)
 {
-    // safety checks
-    if (coordinates.count(cell.coordinate)) { abort(); }
-    if (cell.type == Cell::Type::Black && this->type != Region::Type::Black) { abort(); }
-    if (cell.type == Cell::Type::Numbered && this->type != Region::Type::Numbered) { abort(); }
-    if (cell.type == Cell::Type::White && this->type == Region::Type::Black) { abort(); }
-    // end safety checks
-    
-    coordinates.insert(cell.coordinate);
-    size++;
-    
-    if (cell.type == Grid::Cell::Type::Numbered)
+    for (int i = 0; i < static_cast<int>(Rule::Count); i++)
     {
-        totalSize = cell.number;
+        rules[i].invocations += other.rules[i].invocations;
+        rules[i].productiveInvocations += other.rules[i].productiveInvocations;
+        rules[i].cellsMarked += other.rules[i].cellsMarked;
+        rules[i].nanoseconds += other.rules[i].nanoseconds;
     }
+    totalMarks += other.totalMarks;
+    propagations += other.propagations;
+    maxPropagationDepth = max(maxPropagationDepth, other.maxPropagationDepth);
 }
 
-ostream& operator<<(ostream& o, const Grid::Cell& cell)
+void Grid::SolveStats::writeJSON(ostream& o) const
 {
-    switch (cell.type) {
-        case Grid::Cell::Type::Numbered:
-            o << cell.number;
-            break;
-            
-        case Grid::Cell::Type::Unknown:
-            o << 'U';
-            break;
-            
-        case Grid::Cell::Type::White:
-            o << 'W';
-            break;
-            
-        case Grid::Cell::Type::Black:
-            o << 'B';
-            break;
-            
-        default:
-            break;
+    o << "{\"totalMarks\":" << totalMarks << ",\"propagations\":" << propagations << ",\"maxPropagationDepth\":" << maxPropagationDepth << ",\"rules\":{";
+    for (int i = 0; i < static_cast<int>(Rule::Count); i++)
+    {
+        const auto& ruleStats = rules[i];
+        o << (i == 0 ? "" : ",") << "\"" << ruleName(static_cast<Rule>(i)) << "\":{"
+          << "\"invocations\":" << ruleStats.invocations
+          << ",\"productiveInvocations\":" << ruleStats.productiveInvocations
+          << ",\"cellsMarked\":" << ruleStats.cellsMarked
+          << ",\"nanoseconds\":" << ruleStats.nanoseconds << "}";
     }
-    
-    return o;
+    o << "}}";
 }
 
 ostream& operator<<(ostream& o, const Grid& grid)
@@ -742,15 +2032,33 @@ ostream& operator<<(ostream& o, const Grid& grid)
     o << endl << endl;
     
     // Then print the rest of the grid including y axis
-    int currentRow = 0;
-    const auto& constRows = grid.rows;
-    for (auto&& row : constRows)
+    for (int y = 0; y < grid.height; ++y)
     {
-        o << currentRow++ << string(leftPadding, ' ');
-        const auto& constCells = row;
-        for (auto&& cell : constCells)
+        o << y << string(leftPadding, ' ');
+        for (int x = 0; x < grid.width; ++x)
         {
-            o << cell << ' ';
+            const int index = y * grid.width + x;
+            switch (grid.cellTypes[index]) {
+                case Grid::Cell::Type::Numbered:
+                    o << grid.cellNumbers[index];
+                    break;
+                    
+                case Grid::Cell::Type::Unknown:
+                    o << 'U';
+                    break;
+                    
+                case Grid::Cell::Type::White:
+                    o << 'W';
+                    break;
+                    
+                case Grid::Cell::Type::Black:
+                    o << 'B';
+                    break;
+                    
+                default:
+                    break;
+            }
+            o << ' ';
         }
         o << endl;
     }
@@ -758,5 +2066,13 @@ ostream& operator<<(ostream& o, const Grid& grid)
     return o;
 }
 
-Grid::Region::Region(Region::Type aType): type(aType) { }
-Grid::Cell::Cell(Cell::Type aType, Cell::Coordinate aCoordinate): type(aType), coordinate(aCoordinate) { }
+Grid::Region::Region(NodePool& pool): adjacentUnknownCells(CoordinateSet::allocator_type(pool)) { }
+
+void Grid::Region::reset(Type aType)
+{
+    type = aType;
+    size = 0;
+    totalSize = -1;
+    clueIndex = -1;
+    adjacentUnknownCells.clear();
+}
@@ -10,12 +10,20 @@
 #define Grid_hpp
 
 #include <stdio.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <set>
 #include <utility>
 #include <vector>
-#include <memory>
 #include <ostream>
+#include "Bitboard.hpp"
+#include "NodePool.hpp"
+#include "SolutionVerifier.hpp"
+#include "TranspositionTable.hpp"
+
+class GridSnapshot;
 
 class Grid
 {
@@ -24,6 +32,7 @@ public:
     Grid& operator=(const Grid&) = delete;
     
     friend std::ostream& operator<<(std::ostream&, const Grid&);
+    friend class SolutionVerifier;
     
     /// Default constructor for the Nurikabe grid.
     ///
@@ -33,21 +42,217 @@ public:
     ///     - nummbers: A string that specifies all of the starting numbers in the grid seperated by spaces. The largest number a cell can currently have is 9.
     Grid(int width, int height);
     
+    /// Puts the grid back into the state it was in straight after construction with the new dimensions so that one grid can be used for many puzzles.
+    /// Every piece of internal state has to be put back here, any state that is added to Grid needs a line in this method.
+    void reset(int width, int height);
+    
     /// After you construct the grid, you use this method to load it with data before calling solve
     ///
     /// - Parameters:
     ///     - nummbers: A string that specifies all of the starting numbers in the grid seperated by spaces. The largest number a cell can currently have is 9.
     void loadGrid(const std::string& numbers);
     
-    void solve();
+    /// A numbered cell for loadClues
+    struct Clue
+    {
+        /// The flat index of the cell, y * width + x
+        int index;
+        int number;
+    };
+    
+    /// Loads the grid from the list of its numbered cells instead of a string so numbers can be bigger than 9. Like loadGrid this is called on a new or reset grid before calling solve.
+    void loadClues(const std::vector<Clue>& clues);
+    
+    /// The outcome of running the solver on a grid
+    enum class Result
+    {
+        Solved,         // Every cell is known and the grid is a valid solution
+        Stuck,          // The rules can't deduce anything else, guessing is needed to finish the grid
+        Contradiction   // The grid can't be solved from its current state e.g. the puzzle is malformed
+    };
+    
+    /// Applies the rules until they can't make any more progress
+    ///
+    /// - Returns: Contradiction as soon as the rules produce a state that breaks a Nurikabe rule, otherwise Solved or Stuck
+    Result solve();
+    
+    /// The rules in the order that propagate tries them
+    enum class Rule : uint8_t
+    {
+        CompleteRegions,
+        MultipleAdjacency,
+        Elbow,
+        SinglePathwayBlack,
+        SinglePathwayWhite,
+        N1,
+        Unreachable,
+        GuessingUnreachable,
+        BlackConnectivity,
+        IslandCompletion,
+        Probing,
+        Count
+    };
+    
+    /// Counters for one rule, an invocation is one call of the rule's apply method
+    struct RuleStats
+    {
+        long invocations = 0;
+        /// Invocations that deduced at least one cell
+        long productiveInvocations = 0;
+        long cellsMarked = 0;
+        long long nanoseconds = 0;
+    };
+    
+    /// Statistics gathered since the last call to solve, these are always collected and cost two clock reads per rule invocation
+    struct SolveStats
+    {
+        RuleStats rules[static_cast<int>(Rule::Count)];
+        /// Every cell marked including guesses made by solveWithSearch
+        long totalMarks = 0;
+        /// The number of times the rules were run to a fixpoint, solveWithSearch does this once per guess
+        long propagations = 0;
+        /// The largest number of productive rule invocations it took to reach a fixpoint, i.e. the longest chain of deductions
+        long maxPropagationDepth = 0;
+        
+        const RuleStats& operator[](Rule rule) const { return rules[static_cast<int>(rule)]; };
+        RuleStats& operator[](Rule rule) { return rules[static_cast<int>(rule)]; };
+        
+        static const char* ruleName(Rule);
+        
+        /// Adds the counters of other to these, the depth is the larger of the two. Used to total the stats of the grids of several threads.
+        void add(const SolveStats& other);
+        
+        /// Writes the stats as a single JSON object, rules are keyed by ruleName
+        void writeJSON(std::ostream&) const;
+    };
+    
+    const SolveStats& solveStats() const { return lastSolveStats; };
+    
+    /// Statistics gathered by the last call to solveWithSearch
+    struct SearchStats
+    {
+        /// The number of search nodes that were visited, every guess and the root count as a node
+        long nodes = 0;
+        /// The number of guesses that led to a contradiction and had to be undone
+        long backtracks = 0;
+        /// Wall clock time spent in solveWithSearch
+        double seconds = 0;
+        /// The number of states looked up in the transposition table and how many of them had an outcome that cut the search short
+        long tableProbes = 0;
+        long tableHits = 0;
+        
+        double nodesPerSecond() const { return seconds > 0 ? nodes / seconds : 0; };
+        double tableHitRate() const { return tableProbes > 0 ? static_cast<double>(tableHits) / tableProbes : 0; };
+    };
+    
+    /// Solves the grid with the rules and if they get stuck guesses the colour of an unknown cell, propagates the guess with the rules and backtracks on contradiction.
+    ///
+    /// - Discussion: Guesses are undone by replaying the trail of every change markCell made in reverse so the grid is never copied.
+    /// - Returns: true if the grid was solved, false if the puzzle has no solution
+    bool solveWithSearch();
+    
+    const SearchStats& searchStats() const { return lastSearchStats; };
+    
+    /// Counts the solutions of the puzzle with the same rules and branching as solveWithSearch, the search stops as soon as limit solutions have been found.
+    ///
+    /// - Discussion: Use a limit of 2 to tell whether a puzzle has no solution, a unique solution or more than one. The nodes visited and the time taken are in searchStats.
+    /// The grid is left in the state the rules reached before the first guess.
+    /// - Parameters:
+    ///     - limit: The most solutions to look for, at least 1
+    /// - Returns: The number of solutions found, never more than limit
+    int countSolutions(int limit);
+    
+    /// Makes solveWithSearch and countSolutions look up every state they branch from in table and record the outcome of every state they finish searching,
+    /// so a state that any grid sharing the table has already searched is not searched again. Pass nullptr to stop using a table, the grid doesn't own it.
+    void setTranspositionTable(TranspositionTable* table) { transpositionTable = table; };
+    
+    /// A colour that probing proved a cell must have
+    struct ForcedCell
+    {
+        int index;
+        bool black;
+    };
+    
+    /// Failed literal probing. Tries both colours of each of the given cells that is still unknown by marking it, running the rules to a fixpoint and undoing the changes.
+    /// A colour that leads to a contradiction forces the other colour and any cell that both colours give the same colour is forced to it.
+    ///
+    /// - Discussion: Every cell is probed from the same state, the grid is left as it was and the forced cells are only reported so that disjoint sets of cells can be probed on different threads.
+    /// The same cell can be forced more than once.
+    /// - Parameters:
+    ///     - cellIndices: The flat indices of the cells to probe
+    ///     - forced: Every forced cell is appended to this vector
+    /// - Returns: false if both colours of a cell lead to a contradiction, the grid has no solution from its current state
+    bool probeCells(const std::vector<int>& cellIndices, std::vector<ForcedCell>& forced);
+    
+    /// When true the rules finish with a probing stage that probes every unknown cell whenever the other rules have nothing left to do. It is much more expensive
+    /// than the other rules so it is off by default, it pays off on puzzles that need a lot of guessing.
+    bool probingEnabled = false;
+    
+    /// Lets the probing stage hand the cells to probe to other threads, see ParallelProber
+    struct ProbeSplit
+    {
+        /// Probes the cells against the state of grid the way probeCells does and returns what probeCells would
+        std::function<bool(const Grid&, const std::vector<int>& cellIndices, std::vector<ForcedCell>& forced)> probe;
+    };
+    
+    /// Pass nullptr to probe on the calling thread again, the grid doesn't own the split
+    void setProbeSplit(ProbeSplit* split) { probeSplit = split; };
+    
+    /// Lets solveWithSearch and countSolutions hand part of their search to other threads and be stopped from another thread, see ParallelSearch
+    struct SearchSplit
+    {
+        /// Checked at every search node, once it is set the search unwinds without a result
+        const std::atomic<bool>* cancelled = nullptr;
+        /// Asked at every branch, when it returns true the second colour of the branch is passed to donate instead of being searched by this grid
+        std::function<bool()> wantsWork;
+        /// Called with the grid at the branch point, the flat index of the branch cell and true if the colour to search is black
+        std::function<void(const Grid&, int cellIndex, bool black)> donate;
+    };
+    
+    /// Pass nullptr to search everything on the calling thread again, the grid doesn't own the split. A table entry is never written for a state whose search was split or cancelled.
+    void setSearchSplit(SearchSplit* split) { searchSplit = split; };
+    
+    /// A Zobrist hash of the dimensions, the numbers and the colour of every cell. It is updated as cells are marked and unmarked so it costs nothing to read.
+    uint64_t stateHash() const { return zobristHash; };
+    
+    /// When true, the default, the rules are run with the width and height as compile time constants for the common square sizes.
+    /// Turning it off forces the runtime sized path, the benchmark uses this to measure the difference.
+    bool fixedGeometryEnabled = true;
+    
+    /// Copies probingEnabled, fixedGeometryEnabled and the probe split of grid, used to give the private grids of worker threads the settings of the grid they work for
+    void copySettings(const Grid& grid)
+    {
+        probingEnabled = grid.probingEnabled;
+        fixedGeometryEnabled = grid.fixedGeometryEnabled;
+        probeSplit = grid.probeSplit;
+    };
+    
+    bool hasSameSettings(const Grid& grid) const
+    {
+        return probingEnabled == grid.probingEnabled && fixedGeometryEnabled == grid.fixedGeometryEnabled && probeSplit == grid.probeSplit;
+    };
+    
+    /// - Returns: One character per cell in row order, B for black, W for white including numbered cells and U for unknown
+    std::string cellString() const;
+    
+    /// Captures the colour of every cell and the numbers of the puzzle, the storage of snapshot is reused
+    void saveSnapshot(GridSnapshot& snapshot) const;
+    
+    /// Resets the grid to the dimensions of the snapshot and rebuilds it from the snapshot's numbers and cells, solve and solveWithSearch carry on from there.
+    /// If the snapshot breaks a Nurikabe rule the next solve returns Contradiction.
+    ///
+    /// - Discussion: The cells are unpacked 32 at a time but the regions have to be rebuilt so this is linear in the number of known cells.
+    void loadSnapshot(const GridSnapshot& snapshot);
+    
     int width;
     int height;
     
 private:
     struct Region;
+    struct IslandCompletion;
     struct Cell
     {
-        enum class Type : unsigned short
+        enum class Type : uint8_t
         { White, Black, Unknown, Numbered };
         
         /// The coordinate of the cell - this value is guaranteed to be unique unless the string input to the solver is malformed
@@ -83,29 +288,34 @@ private:
                 return coord < coordTypePair.coord;
             }
         };
-        
-        Cell(Type type, Coordinate coordinate);
-        
-        std::shared_ptr<Region> region;
-        int number = -1;
-        Coordinate coordinate;
-        Type type = Type::Unknown;
     };
     
+    /// The node based containers take their nodes from the grid's NodePool so a grid that is reset and reused stops allocating once it has seen its biggest puzzle
+    typedef std::set<Cell::Coordinate, std::less<Cell::Coordinate>, PoolAllocator<Cell::Coordinate>> CoordinateSet;
+    typedef std::set<int, std::less<int>, PoolAllocator<int>> RegionIdSet;
+    
     struct Region
     {
         enum class Type
         { White, Black, Numbered };
         
-        Region(Type type);
+        Region(NodePool& pool);
+        Region(Region&&) = default;
+        Region& operator=(Region&&) = default;
         Region(const Region&) = delete;
         Region& operator=(const Region&) = delete;
         
-        Type type;
+        Type type = Type::White;
         int size = 0;
         int totalSize = -1;
+        /// The flat index of the numbered cell in this region or -1 if the region does not contain a number
+        int clueIndex = -1;
         
-        void addCell(const Cell& cell);
+        /// Adds the cell at the flat index cellIndex to this region, cellType and number are the values stored for that cell in the grid
+        /// The cell has to be the same colour as the region, markCell only ever adds cells to regions of the same colour.
+        void addCell(int cellIndex, Cell::Type cellType, int number);
+        /// Turns the entry into a new empty region of the given type, the nodes of the old adjacent unknown cell set go back to the pool
+        void reset(Type type);
         bool isComplete() const { return totalSize == size; };
         
         bool operator <(const Region& region) const
@@ -113,98 +323,487 @@ private:
             return size < region.size;
         }
         
-        void mergeWith(const Region&);
+        /// Folds the aggregates of another region into this one. The smaller of the two adjacent unknown cell sets is inserted into the larger one so the merged region ends up owning the larger set without copying it.
+        /// The absorbed region keeps whatever set it is left with so that the merge can be undone. Both regions have to be black or both have to be white.
+        ///
+        /// - Parameters:
+        ///     - insertedCells: Every cell that was not already in the larger set is appended to this vector
+        /// - Returns: true if the two sets were swapped before inserting
+        bool mergeWith(Region&, std::vector<Cell::Coordinate>& insertedCells);
+        
+        CoordinateSet adjacentUnknownCells;
+    };
+    
+    /// A FIFO of cell, region or 2x2 window indices that a rule still has to look at.
+    /// An index is only queued once at a time so marking cells in the same neighbourhood over and over doesn't grow the queue.
+    struct WorkQueue
+    {
+        void reset(int capacity);
+        void push(int index);
+        int pop();
+        bool empty() const { return head == items.size(); };
+        void clear();
         
-        std::set<Cell::Coordinate> coordinates = std::set<Cell::Coordinate>();
-        std::set<Cell::Coordinate> adjacentUnknownCells = std::set<Cell::Coordinate>();
+        std::vector<int> items = std::vector<int>();
+        std::vector<bool> queued = std::vector<bool>();
+        size_t head = 0;
     };
     
-    friend std::vector<Cell::CoordinateTypePair> debugOutputHelper(std::vector<Cell::CoordinateTypePair>(Grid::*)(), Grid&, const std::string&);
+    friend void debugOutputHelper(const std::vector<Cell::CoordinateTypePair>&, Grid&, const char*);
     
     /// This rule states that any complete white regions must be bordered by black cells
     ///
-    /// - Returns: A vector containing pairs of coordinates along with the type that they should be marked or an empty vector if the rule could not be applied.
-    std::vector<Cell::CoordinateTypePair> applyRuleCompleteRegions();
+    /// - Parameters:
+    ///     - regionId: The region to check
+    ///     - changes: Pairs of coordinates along with the type that they should be marked are appended to this vector
+    void applyRuleCompleteRegions(int regionId, std::vector<Cell::CoordinateTypePair>& changes);
     
     /// This rule states that if a cell is adjacent to two or more numbers it must be black
     /// TODO: I belive this can be generalized to apply to cells that are adjacent to incomplete white regions
     ///
-    /// - Returns: A vector containing pairs of coordinates along with the type that they should be marked or an empty vector if the rule could not be applied.
-    std::vector<Cell::CoordinateTypePair> applyRuleMutipleAdjacency();
+    /// - Parameters:
+    ///     - cellIndex: The flat index of the cell to check, nothing happens if the cell is no longer unknown
+    ///     - changes: Pairs of coordinates along with the type that they should be marked are appended to this vector
+    void applyRuleMutipleAdjacency(int cellIndex, std::vector<Cell::CoordinateTypePair>& changes);
     
     /// This rule states that we cannot have a 2x2 square of black cells so if there is a 'L' shaped elbow of black cells then the cell in the curve must be white
+    /// Every window on the grid is checked at once with the bitboard kernels so this only runs once black cells have been marked since it last ran.
     ///
-    /// - Returns: A vector containing pairs of coordinates along with the type that they should be marked or an empty vector if the rule could not be applied.
-    std::vector<Cell::CoordinateTypePair> applyRuleElbow();
+    /// - Parameters:
+    ///     - changes: Pairs of coordinates along with the type that they should be marked are appended to this vector
+    void applyRuleElbow(std::vector<Cell::CoordinateTypePair>& changes);
     
     /// Since all black cells must be connected if there is a region of black cells with only one adjacent unknown cell then that cell must be black
     ///
-    /// - Returns: A vector containing pairs of coordinates along with the type that they should be marked or an empty vector if the rule could not be applied.
-    std::vector<Cell::CoordinateTypePair> applyRuleSinglePathwayBlack();
+    /// - Parameters:
+    ///     - regionId: The region to check
+    ///     - changes: Pairs of coordinates along with the type that they should be marked are appended to this vector
+    void applyRuleSinglePathwayBlack(int regionId, std::vector<Cell::CoordinateTypePair>& changes);
     
     /// If there is only one way for an incomplete white region to expand then that unknown cell is white
     ///
-    /// - Returns: A vector containing pairs of coordinates along with the type that they should be marked or an empty vector if the rule could not be applied.
-    std::vector<Cell::CoordinateTypePair> applyRuleSinglePathwayWhite();
+    /// - Parameters:
+    ///     - regionId: The region to check
+    ///     - changes: Pairs of coordinates along with the type that they should be marked are appended to this vector
+    void applyRuleSinglePathwayWhite(int regionId, std::vector<Cell::CoordinateTypePair>& changes);
     
     /// If a numbered region has N-1 cells (it only needs one more marked cell to be considered complete) and there are only two options left to expand and those options touch diagonally then the cell in between is black
     ///
-    /// - Returns: A vector containing pairs of coordinates along with the type that they should be marked or an empty vector if the rule could not be applied.
-    std::vector<Grid::Cell::CoordinateTypePair> applyRuleN1();
+    /// - Parameters:
+    ///     - regionId: The region to check
+    ///     - changes: Pairs of coordinates along with the type that they should be marked are appended to this vector
+    void applyRuleN1(int regionId, std::vector<Cell::CoordinateTypePair>& changes);
     
     /// If the shortest path from an unknown cell to a numbered region would make the numbered region too big then that cell is unreachable and should be marked black
+    /// The rule reads the reach budgets (see updateReachBudgets) so it only looks at the cells whose budget could have changed since it last ran.
     ///
-    /// - Returns: A vector containing pairs of coordinates along with the type that they should be marked or an empty vector if the rule could not be applied.
-    std::vector<Grid::Cell::CoordinateTypePair> applyRuleUnreachable();
+    /// - Parameters:
+    ///     - changes: Pairs of coordinates along with the type that they should be marked are appended to this vector
+    void applyRuleUnreachable(std::vector<Cell::CoordinateTypePair>& changes);
     
     /// If you have a 2x2 square of cells with 2 black and 2 unknown and marking one of the unknown cells as black causes the other to be unreachable then that is a contradiction via the no-pool-rule so the guessed black cell must be white.
+    /// Only the windows within range of a cell that was marked since the last pass are checked, the same range that bounds the reach budget updates. The reach budgets have to be up to date.
+    ///
+    /// - Parameters:
+    ///     - changes: Pairs of coordinates along with the type that they should be marked are appended to this vector
+    void applyRuleGuessingUnreachable(std::vector<Cell::CoordinateTypePair>& changes);
+    template <typename Geometry>
+    void applyRuleGuessingUnreachable(const Geometry& geometry, std::vector<Cell::CoordinateTypePair>& changes);
+    
+    /// All of the black cells have to join up through cells that aren't white. A depth first search over the unknown cells and the black regions, with each black region as a single node,
+    /// finds the articulation points in linear time (Tarjan): an unknown cell that cuts black cells off from the rest of the black cells must be black, which generalises the single pathway black rule to every chokepoint.
+    /// Black cells that the search doesn't reach can never join up so the grid is a contradiction, and unknown cells it doesn't reach can't be black so they are white.
     ///
-    /// - Returns: A vector containing pairs of coordinates along with the type that they should be marked or an empty vector if the rule could not be applied.
-    std::vector<Grid::Cell::CoordinateTypePair> applyRuleGuessingUnreachable();
+    /// - Parameters:
+    ///     - changes: Pairs of coordinates along with the type that they should be marked are appended to this vector
+    void applyRuleBlackConnectivity(std::vector<Cell::CoordinateTypePair>& changes);
+    /// Puts a node on the black connectivity search stack with the given order along with the nodes next to it
+    void pushConnectivityNode(int node, int order);
     
-    /// Find if a unknown cell is not connectable to any white or numbered region
+    /// Numbered regions with only a few cells left to place are finished in every way they can be: each completion is a connected set of unknown and white cells within reach of the region,
+    /// the right size, and not touching any white cell that isn't part of it. A cell that is in every completion must be white and a cell that borders every completion must be black.
+    /// A region with no completions at all is a contradiction. Completions are cached per region (see IslandCompletion) and the work done for a single region is capped.
     ///
     /// - Parameters:
-    ///     - coord: The coordinate of the unknown cell that will be used as a starting point for the depth first search
+    ///     - changes: Pairs of coordinates along with the type that they should be marked are appended to this vector
+    void applyRuleIslandCompletion(std::vector<Cell::CoordinateTypePair>& changes);
+    /// Collects the cells whose types the completions of the region containing clueIndex depend on into islandCells, the region's own cells first,
+    /// then the cells it can grow into and then the cells around those. Returns false if the cells it can grow into don't fit in a 64 bit mask.
+    bool collectIslandCells(int clueIndex, int cellsLeft);
+    /// Enumerates the completions of the island collected by collectIslandCells and stores what they force in completion
+    void enumerateIslandCompletions(int cellsLeft, IslandCompletion& completion);
+    /// Grows the island by one of the untried cells at a time until it has cellsLeft more cells, each connected set of cells is reached exactly once (Redelmeier)
+    void extendIsland(uint64_t island, uint64_t untried, uint64_t seen, int cellsLeft);
+    
+    /// Probes every unknown cell with probeCells, or the probe split if there is one, and marks the cells it forces
+    ///
+    /// - Parameters:
+    ///     - changes: Pairs of coordinates along with the type that they should be marked are appended to this vector
+    void applyRuleProbing(std::vector<Cell::CoordinateTypePair>& changes);
+    
+    /// Runs the rules until none of them can make any more changes
+    ///
+    /// - Discussion: The cheap local rules only look at the cells, regions and windows that markCell has queued for them, they are tried in order and after
+    /// every change we go back to the first rule that has queued work. The unreachable rules look at the whole grid so they only run once all of the queues are empty
+    /// and something has been marked since they last ran. Everything is done in a loop so the stack doesn't grow with the number of deductions.
+    void propagate();
+    
+    /// Queues a region for every rule that works on regions of its type
+    void queueRegion(int regionId);
+    
+    /// The budget an unknown cell gets from the white and numbered regions next to it, this is how many unknown cells (counting this one) a path that ends at this cell
+    /// can add before the island it joins is too big.
+    ///
+    /// - Parameters:
+    ///     - isSource: Set to false if the cell doesn't touch any white or numbered region, in that case the cell only gets a budget from its neighbours
+    int sourceReachBudget(int cellIndex, bool& isSource) const;
+    
+    /// Brings reachBudgets up to date with one multi-source breadth first search from every cell next to a white or numbered region.
+    ///
+    /// - Discussion: Budgets drop by one for every step away from a source so a change can only affect cells within 2 * maxRegionSize + 1 steps of it
+    /// (the region that changed plus the distance its budget can travel). When the budgets are already valid only the cells in that range of reachChangedCells are recomputed,
+    /// seeded from the sources in range and the budgets of the cells just outside it. The search processes cells in buckets of decreasing budget so it is linear in the cells visited.
+    ///
+    /// - Parameters:
+    ///     - updatedCells: Filled with the flat index of every cell whose budget was recomputed
+    template <typename Geometry>
+    void updateReachBudgets(const Geometry& geometry, std::vector<int>& updatedCells);
+    
+    /// Collects every cell within 2 * maxRegionSize + 1 steps of the changed cells, the cells outside that range can't have their reachability affected by the changes
+    ///
+    /// - Parameters:
+    ///     - cellsInRange: Filled with the flat index of every cell in range, each of them is also stamped with the current reachStamp
+    template <typename Geometry>
+    void collectCellsInReachRange(const Geometry& geometry, const std::vector<int>& changedCells, std::vector<int>& cellsInRange);
+    
+    /// Find if an unknown cell would not be connectable to any white or numbered region if another unknown cell was black
+    ///
+    /// - Discussion: This is a breadth first search from the unknown cell that skips every cell whose reach budget is too small for the path to get anywhere from it.
+    /// The budgets were computed with the other cell unknown so they are an upper bound on the budgets with it black.
+    ///
+    /// - Parameters:
+    ///     - cellIndex: The flat index of the unknown cell that will be used as a starting point for the search
+    ///     - blackCellIndex: The flat index of the unknown cell to treat as black
     /// - Returns: true if no path was found, otherwise false
-    bool unreachable(Cell::Coordinate unknownCoord, std::set<Cell::Coordinate>) const;
+    template <typename Geometry>
+    bool unreachableWithBlackCell(const Geometry& geometry, int cellIndex, int blackCellIndex);
     
     /// This is a helper function that calls markCell for each CoordinateTypePair in the std::vector of CoordinateTypePairs
+    /// Pairs for cells that have already been marked with the same type are skipped because several rules can deduce the same cell.
     void markCells(const std::vector<Cell::CoordinateTypePair>&);
     
     /// Modifies the rows and regions containers in Grid with the CoordinateTypePair information
     ///
     /// - Discussion: This method is responsible for keeping all of the internal state inside Grid consistent.
     /// This includes merging regions, creating new regions, erasing regions that have been merged into other regions etc etc.
+    /// It also queues everything around the cell that the rules need to re-check.
     /// This method is not thread safe at all. When this method executes all of the internal state of Grid will be modified.
+    /// If the change leaves the grid in a state that can't be solved the contradiction flag is set, the change is still made so it can be undone like any other.
     void markCell(Cell::CoordinateTypePair);
     
+    /// Makes the cell at the flat index a numbered cell that is the root of its own region, used by both ways of loading a grid
+    void addClue(int index, int number);
+    
+    /// Sets the contradiction flag if the region is bigger than it is allowed to be or it has no adjacent unknown cells left before it is finished
+    void checkRegion(int regionId);
+    
+    /// Sets the contradiction flag if the 2x2 window with its top left cell at windowIndex is all black
+    void checkPool(int windowIndex);
+    
     // TODO: Think about adding noexcept everywhere
     // Internal State
+    /// Declared before every container that uses it so that it is constructed before them and destroyed after them
+    NodePool nodePool;
     long numberOfKnownCells = 0;
     int maxRegionSize = 0;
     int totalBlackCells = 0;
-    std::vector<std::vector<Cell>> rows;
-    std::set<std::shared_ptr<Region>> regions = std::set<std::shared_ptr<Region>>();
-    std::shared_ptr<Region> mergeRegions(std::vector<std::shared_ptr<Region>>&);
-    std::set<Cell::Coordinate> unknownCellCoords = std::set<Cell::Coordinate>();
-    std::set<Cell::Coordinate> blackCellCoords = std::set<Cell::Coordinate>();
+    
+    // Cell state is stored as a structure of arrays, every array is indexed by y * width + x (see indexForCoordinate)
+    std::vector<Cell::Type> cellTypes;
+    std::vector<int> cellNumbers;
+    
+    /// The same cell types packed one bit per cell for the rules that look at 2x2 windows, numbered cells are white
+    Bitboard blackCells;
+    Bitboard whiteCells;
+    Bitboard unknownCells;
+    /// Scratch space for the window kernels
+    Bitboard matchedWindows;
+    
+    /// The flat indices of the cells next to a cell in the order below, above, left and right. There are at most four so they are stored inline.
+    struct Neighbours
+    {
+        int indices[4];
+        int count = 0;
+        
+        const int* begin() const { return indices; };
+        const int* end() const { return indices + count; };
+    };
+    /// The neighbours of every cell, built by reset
+    std::vector<Neighbours> neighbourTable = std::vector<Neighbours>();
+    
+    /// Regions are tracked with a disjoint-set forest over the cells. Each known cell points at its parent cell, a region's id is the flat index of its root cell and unknown cells have a parent of -1.
+    /// Mutable because path compression in regionForCell is an implementation detail that does not change the logical state of the grid.
+    mutable std::vector<int> regionParents;
+    
+    /// Per-root aggregates for every region, indexed by the flat index of the region's root cell. Entries for cells that are not roots are stale.
+    std::vector<Region> regionPool;
+    /// The ids of the regions that are still live i.e. have not been merged into another region
+    RegionIdSet regions = RegionIdSet(RegionIdSet::allocator_type(nodePool));
+    
+    /// Finds the id of the region that the cell at cellIndex belongs to, compressing the path to the root as it goes
+    ///
+    /// - Returns: The flat index of the root cell of the region or -1 if the cell is unknown
+    int regionForCell(int cellIndex) const;
+    
+    /// Merges every region in the vector using union by size, no member cells are visited.
+    /// Merging more than one numbered region sets the contradiction flag.
+    ///
+    /// - Returns: The id of the merged region
+    int mergeRegions(const std::vector<int>&);
+    /// Scratch space for mergeRegions so merging doesn't allocate
+    std::vector<Cell::Coordinate> mergeInsertedCells = std::vector<Cell::Coordinate>();
+    /// Scratch space for markCell
+    std::vector<int> markAdjacentRegionIds = std::vector<int>();
+    std::vector<int> markBorderingRegionIds = std::vector<int>();
+    CoordinateSet unknownCellCoords = CoordinateSet(CoordinateSet::allocator_type(nodePool));
+    
+    // Propagation State
+    
+    /// The reach budget of every unknown cell, a cell with a budget below 1 can't be joined to any island. Known cells have a budget of 0.
+    std::vector<int> reachBudgets;
+    bool reachBudgetsValid = false;
+    /// Cells that have been marked since reachBudgets was last brought up to date
+    std::vector<int> reachChangedCells = std::vector<int>();
+    /// Cells stamped with the current value of reachStamp are the ones being recomputed, stamping saves clearing a visited array for every update
+    std::vector<int> reachStamps;
+    int reachStamp = 0;
+    std::vector<std::vector<int>> reachBuckets = std::vector<std::vector<int>>();
+    std::vector<int> reachUpdatedCells = std::vector<int>();
+    /// Whether each unknown cell touches a white or numbered region, kept up to date along with reachBudgets
+    std::vector<bool> reachSources;
+    
+    /// Cells that have been marked since the guessing unreachable rule last ran, the rule checks every window when this isn't valid
+    std::vector<int> guessingChangedCells = std::vector<int>();
+    bool guessingChangedCellsValid = false;
+    std::vector<int> guessingCellsInRange = std::vector<int>();
+    WorkQueue guessingWindowQueue;
+    /// Scratch space for unreachableWithBlackCell, a cell has been visited by the current search when its stamp equals hypothesisStamp
+    std::vector<int> hypothesisStamps;
+    int hypothesisStamp = 0;
+    std::vector<std::pair<int, int>> hypothesisQueue = std::vector<std::pair<int, int>>();
+    
+    // Black Connectivity State
+    
+    /// A node of the black connectivity search, either an unknown cell or a whole black region named by its region id.
+    /// Its neighbouring nodes are the entries of connectivityAdjacency from begin up to the next node's begin and next is the first one it hasn't looked at yet.
+    struct ConnectivityFrame
+    {
+        int node;
+        int begin;
+        int next;
+    };
+    
+    /// The order the depth first search reached each node in and the lowest order reachable from the node's subtree through one back edge.
+    /// Orders keep counting up from one search to the next, a node hasn't been reached by the current search if its order is at most the base.
+    std::vector<int> connectivityOrder = std::vector<int>();
+    int connectivityOrderBase = 0;
+    std::vector<int> connectivityLow = std::vector<int>();
+    /// The number of black cells in each node's subtree of the depth first search
+    std::vector<int> connectivityBlackBelow = std::vector<int>();
+    /// The explicit stack of the depth first search and the neighbours of every node on it
+    std::vector<ConnectivityFrame> connectivityStack = std::vector<ConnectivityFrame>();
+    std::vector<int> connectivityAdjacency = std::vector<int>();
+    
+    // Island Completion State
+    
+    /// Only regions with at most this many cells left to place are enumerated
+    static const int islandCompletionMaxCellsLeft = 6;
+    /// The most partial islands a single enumeration looks at before it gives up without deducing anything
+    static const int islandCompletionMaxSteps = 1024;
+    
+    /// What the completions of one numbered region force, along with the cells they were worked out from and the types those cells had.
+    /// The completions only depend on those cells so while they all have the same types the deductions can be reused, including after the search backtracks to a state it has seen before.
+    struct IslandCompletion
+    {
+        std::vector<int> cells = std::vector<int>();
+        std::vector<Cell::Type> types = std::vector<Cell::Type>();
+        std::vector<Cell::CoordinateTypePair> deductions = std::vector<Cell::CoordinateTypePair>();
+        bool contradiction = false;
+        /// The value of islandChangeCount when the types were last known to match, if none of the cells has changed since then they don't have to be compared
+        long checkedAt = 0;
+    };
+    /// One entry for each numbered cell in the same order as clueCellIndices
+    std::vector<IslandCompletion> islandCompletions = std::vector<IslandCompletion>();
+    
+    /// The cells collected by collectIslandCells with their types and their distance from the region. The first islandRegionSize cells are the region's own,
+    /// the next islandCandidateCount cells are the cells the region can grow into and they take the first bits of the masks below, the unknown cells around them take the bits after that.
+    std::vector<int> islandCells = std::vector<int>();
+    std::vector<Cell::Type> islandTypes = std::vector<Cell::Type>();
+    std::vector<int> islandDistances = std::vector<int>();
+    int islandRegionSize = 0;
+    int islandCandidateCount = 0;
+    /// A cell has been collected when its stamp equals islandStamp, islandBits is then its bit in the masks, -1 for a cell of the region itself and -2 for any other cell without a bit
+    std::vector<int> islandStamps = std::vector<int>();
+    int islandStamp = 0;
+    std::vector<int> islandBits = std::vector<int>();
+    /// The cell for each bit of the masks
+    std::vector<int> islandBitCells = std::vector<int>();
+    /// The value of islandChangeCount when each cell was last marked or unmarked, the count goes up by one every time
+    std::vector<long> islandCellChanges = std::vector<long>();
+    long islandChangeCount = 0;
+    
+    /// For each cell that the island can grow into, the cells next to it that it can grow into, the white cells next to it that have to come with it and the unknown cells next to it
+    std::vector<uint64_t> islandAdjacent = std::vector<uint64_t>();
+    std::vector<uint64_t> islandWhiteAdjacent = std::vector<uint64_t>();
+    std::vector<uint64_t> islandBorder = std::vector<uint64_t>();
+    /// The unknown cells next to the region itself
+    uint64_t islandRegionBorder = 0;
+    /// The intersection of the completions and of their borders so far, the number of completions and the partial islands looked at by the current enumeration
+    uint64_t islandInEvery = 0;
+    uint64_t islandBorderOfEvery = 0;
+    long islandCompletionCount = 0;
+    int islandSteps = 0;
+    
+    /// The deductions of the rule that propagate is running, kept between calls so it doesn't allocate
+    std::vector<Cell::CoordinateTypePair> propagateChanges = std::vector<Cell::CoordinateTypePair>();
+    WorkQueue completeRegionsQueue;
+    WorkQueue multipleAdjacencyQueue;
+    WorkQueue singlePathwayBlackQueue;
+    WorkQueue singlePathwayWhiteQueue;
+    WorkQueue n1Queue;
+    bool elbowDirty = true;
+    bool unreachableDirty = true;
+    bool guessingUnreachableDirty = true;
+    bool blackConnectivityDirty = true;
+    bool islandCompletionDirty = true;
+    /// Set whenever a cell is marked, the probing stage only runs again once something has changed since it last ran
+    bool probingDirty = true;
+    /// Set while probeCells runs so that the rules it runs don't start probing themselves
+    bool probing = false;
+    ProbeSplit* probeSplit = nullptr;
+    std::vector<int> probeCellIndices = std::vector<int>();
+    std::vector<ForcedCell> probeForcedCells = std::vector<ForcedCell>();
+    /// The colour the first probe of a cell gave every cell it marked, only valid where probeStamps matches probeStamp
+    std::vector<Cell::Type> probeTypes = std::vector<Cell::Type>();
+    std::vector<int> probeStamps = std::vector<int>();
+    int probeStamp = 0;
+    /// Set as soon as the state of the grid can no longer lead to a solution. markCell only checks what a change can break so this is cheap to keep up to date:
+    /// a deduction that conflicts with a known cell, an overfull island, two numbers in one island, a 2x2 pool and a region that is boxed in before it is done.
+    bool contradiction = false;
+    
+    // Search State
+    
+    /// One change made to the grid state while the trail is being recorded, undoing an entry restores the state from before the change
+    struct TrailEntry
+    {
+        enum class Kind : uint8_t
+        {
+            MarkCell,       // cellIndex went from unknown to known
+            CreateRegion,   // regionId was added to regions
+            MergeRegions,   // cellIndex (a region root) was merged into regionId
+            RegionFields,   // type, size, totalSize and clueIndex of regionId before it was changed
+            FrontierInsert, // cellIndex was inserted into the adjacent unknown cells of regionId
+            FrontierErase   // cellIndex was erased from the adjacent unknown cells of regionId
+        };
+        
+        TrailEntry(Kind aKind, int aRegionId, int aCellIndex): kind(aKind), regionId(aRegionId), cellIndex(aCellIndex) {};
+        
+        Kind kind;
+        Region::Type regionType = Region::Type::White;
+        bool swappedFrontiers = false;
+        int regionId;
+        int cellIndex;
+        int size = 0;
+        int totalSize = -1;
+        int clueIndex = -1;
+    };
+    
+    std::vector<TrailEntry> trail = std::vector<TrailEntry>();
+    /// While this is set every change markCell makes is recorded on the trail and regionForCell stops compressing paths so that everything can be undone
+    bool recordingTrail = false;
+    std::vector<int> clueCellIndices = std::vector<int>();
+    SearchStats lastSearchStats = SearchStats();
+    SolveStats lastSolveStats = SolveStats();
+    uint64_t zobristHash = 0;
+    TranspositionTable* transpositionTable = nullptr;
+    /// The random key xored into the hash for a cell with the given value, value is the Cell::Type of a white or black cell and the number + 2 of a numbered cell
+    static uint64_t zobristKey(int cellIndex, int value);
+    
+    /// The contradiction flag doesn't catch every broken rule, e.g. black cells that were split apart, so a grid with no unknown cells left is checked before it is accepted
+    SolutionVerifier leafVerifier;
+    
+    /// Depth first search from the current state, which has to be a propagated fixpoint
+    ///
+    /// - Returns: true if a solution was found, the grid is left in the solved state. Otherwise the grid is left as it was.
+    bool search();
+    
+    /// Depth first search from the current state that visits every solution until count reaches limit, the grid is left as it was
+    void countSolutionsFrom(int limit, int& count);
+    
+    SearchSplit* searchSplit = nullptr;
+    /// The number of branches handed to another thread, a search below a state is only complete if this didn't change while it ran
+    long searchDonations = 0;
+    bool searchCancelled() const { return searchSplit != nullptr && searchSplit->cancelled != nullptr && searchSplit->cancelled->load(std::memory_order_relaxed); };
+    /// Passes the given colour of the branch cell to the search split if it wants work
+    ///
+    /// - Returns: true if the branch was handed off and must not be searched here
+    bool donateBranch(Cell::Coordinate coord, Cell::Type type);
+    
+    /// Picks the cell to guess next and the colour to try first
+    Cell::CoordinateTypePair branchCell() const;
+    
+    /// Undoes trail entries until the trail is back to trailSize entries, the queues are cleared because the state we return to was a fixpoint
+    void undoTo(size_t trailSize);
+    
+    /// Records a copy of the scalar fields of a region so they can be restored by undoTo
+    void recordRegionFields(int regionId);
+    
     
     // Helpers
-    std::vector<Cell::Coordinate> cellCoordinatesAdjacentTo(Cell::CoordinateTypePair) const;
-    std::vector<Cell::Coordinate> cellCoordinatesAdjacentTo(Cell::Coordinate) const;
-    std::vector<Cell::Coordinate> cellCoordinatesAdjacentTo(const Cell&) const;
-    bool isCoordinateInBounds(Cell::Coordinate) const;
+    const Neighbours& neighbours(int cellIndex) const { return neighbourTable[cellIndex]; }
+    
+    /// The dimensions of a grid fixed at compile time. The solver's breadth first searches are instantiated for the common puzzle sizes so that
+    /// the compiler can fold the dimensions into the neighbour arithmetic and drop the border checks it can prove are never needed.
+    template <int Width, int Height>
+    struct FixedGeometry
+    {
+        static constexpr int width = Width;
+        static constexpr int height = Height;
+    };
+    
+    /// The dimensions of a grid that isn't one of the sizes in withGeometry
+    struct RuntimeGeometry
+    {
+        int width;
+        int height;
+    };
+    
+    /// Calls visitor with the FixedGeometry for the grid's dimensions or a RuntimeGeometry if there isn't one
+    template <typename Visitor>
+    void withGeometry(Visitor visitor);
+    
+    /// Calls visitor with the flat index of every neighbour of the cell, in the same order as neighbours
+    template <typename Geometry, typename Visitor>
+    static void forEachNeighbour(const Geometry& geometry, int cellIndex, Visitor visitor);
+    /// Calls visitor with the flat index of every neighbour of the cell that has the given type
+    template <typename Visitor>
+    void forEachNeighbour(int cellIndex, Cell::Type type, Visitor visitor) const;
     bool areCoordinatesDiagonal(Cell::Coordinate, Cell::Coordinate) const;
-    Cell::Coordinate coordinateToChangeWhiteBasedOnElbowRule(Cell::Coordinate) const;
-    const Cell& cellForCoordinate(Cell::Coordinate) const;
-    void solve(const std::vector<Cell::CoordinateTypePair>&);
+    Cell::Type typeForCoordinate(Cell::Coordinate coord) const { return cellTypes[indexForCoordinate(coord)]; }
+    int indexForCoordinate(Cell::Coordinate coord) const { return coord.y * width + coord.x; }
+    Cell::Coordinate coordinateForIndex(int index) const { return Cell::Coordinate(index % width, index / width); }
     Cell::Coordinate coordinateFromIterator(const std::string::const_iterator&, const std::string&) const;
-
-    friend std::ostream& operator<<(std::ostream&, const Grid::Cell&);
 };
 
-std::ostream& operator<<(std::ostream&, const Grid::Cell&);
+template <typename Visitor>
+void Grid::forEachNeighbour(int cellIndex, Cell::Type type, Visitor visitor) const
+{
+    for (auto adjacentIndex : neighbours(cellIndex))
+    {
+        if (cellTypes[adjacentIndex] == type) { visitor(adjacentIndex); }
+    }
+}
+
 std::ostream& operator<<(std::ostream&, const Grid&);
 
 #endif /* Grid_hpp */
@@ -0,0 +1,86 @@
+//
+//  GridSnapshot.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "GridSnapshot.hpp"
+
+using namespace std;
+
+namespace
+{
+    /// Combines a value into a hash the way boost::hash_combine does and then scrambles the result with the splitmix64 finalizer so every input bit reaches every output bit
+    uint64_t mix(uint64_t hash, uint64_t value)
+    {
+        hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+        hash ^= hash >> 30;
+        hash *= 0xbf58476d1ce4e5b9ULL;
+        hash ^= hash >> 27;
+        hash *= 0x94d049bb133111ebULL;
+        hash ^= hash >> 31;
+        return hash;
+    }
+}
+
+GridSnapshot::GridSnapshot(int aWidth, int aHeight)
+{
+    clear(aWidth, aHeight);
+}
+
+void GridSnapshot::clear(int aWidth, int aHeight)
+{
+    width = aWidth;
+    height = aHeight;
+    wordsPerRow = (aWidth + 31) / 32;
+    clues.clear();
+    words.assign(wordsPerRow * aHeight, 0);
+}
+
+void GridSnapshot::setCell(int x, int y, CellState state)
+{
+    auto& word = words[wordIndex(x, y)];
+    word &= ~(uint64_t(3) << shiftForColumn(x));
+    word |= uint64_t(state) << shiftForColumn(x);
+}
+
+bool GridSnapshot::isComplete() const
+{
+    // A cell is known when either of its bits is set, so fold the black bits onto the white bits and count the cells in each row word
+    for (int y = 0; y < height; y++)
+    {
+        int knownCells = 0;
+        for (int i = 0; i < wordsPerRow; i++)
+        {
+            const uint64_t word = words[y * wordsPerRow + i];
+            knownCells += __builtin_popcountll((word | (word >> 1)) & 0x5555555555555555ULL);
+        }
+        if (knownCells != width) { return false; }
+    }
+    return true;
+}
+
+size_t GridSnapshot::hash() const
+{
+    uint64_t hash = mix(static_cast<uint64_t>(width), static_cast<uint64_t>(height));
+    for (const auto& clue : clues)
+    {
+        hash = mix(hash, (static_cast<uint64_t>(clue.index) << 32) | static_cast<uint32_t>(clue.number));
+    }
+    for (auto word : words)
+    {
+        hash = mix(hash, word);
+    }
+    return static_cast<size_t>(hash);
+}
+
+bool GridSnapshot::operator==(const GridSnapshot& snapshot) const
+{
+    if (width != snapshot.width || height != snapshot.height || clues.size() != snapshot.clues.size() || words != snapshot.words) { return false; }
+    for (size_t i = 0; i < clues.size(); i++)
+    {
+        if (clues[i].index != snapshot.clues[i].index || clues[i].number != snapshot.clues[i].number) { return false; }
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+//
+//  GridSnapshot.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef GridSnapshot_hpp
+#define GridSnapshot_hpp
+
+#include "Grid.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/// The colour of every cell of a grid packed into 2 bits per cell along with the numbers of the puzzle.
+///
+/// - Discussion: Snapshots are cheap to copy, compare and hash so that searches, caches and worker threads can pass grid states around without a Grid.
+/// Every row starts on a new word, 32 cells per word, so converting to and from the row packed bitboards of a Grid takes a few instructions per 32 cells.
+/// Use Grid::saveSnapshot to capture a grid and Grid::loadSnapshot to rebuild one.
+class GridSnapshot
+{
+public:
+    /// The 2 bit value of a cell, numbered cells are White
+    enum class CellState : uint8_t
+    {
+        Unknown = 0,
+        White = 1,
+        Black = 2
+    };
+    
+    GridSnapshot(int width = 0, int height = 0);
+    
+    /// Makes every cell unknown, removes the numbers and changes the dimensions, the storage is reused when it is big enough
+    void clear(int width, int height);
+    
+    CellState cell(int x, int y) const { return static_cast<CellState>((words[wordIndex(x, y)] >> shiftForColumn(x)) & 3); };
+    void setCell(int x, int y, CellState state);
+    
+    /// - Returns: true if no cell is unknown
+    bool isComplete() const;
+    
+    /// A hash of the dimensions, numbers and every cell, equal snapshots always have equal hashes
+    size_t hash() const;
+    
+    bool operator==(const GridSnapshot&) const;
+    bool operator!=(const GridSnapshot& snapshot) const { return !(*this == snapshot); };
+    
+    int width = 0;
+    int height = 0;
+    int wordsPerRow = 0;
+    /// The numbered cells in increasing index order
+    std::vector<Grid::Clue> clues = std::vector<Grid::Clue>();
+    /// height * wordsPerRow words, cell x of row y is bits 2 * (x % 32) and up of word y * wordsPerRow + x / 32. Bits past the width of a row are always zero.
+    std::vector<uint64_t> words = std::vector<uint64_t>();
+
+private:
+    int wordIndex(int x, int y) const { return y * wordsPerRow + x / 32; };
+    static int shiftForColumn(int x) { return 2 * (x % 32); };
+};
+
+namespace std
+{
+    template <>
+    struct hash<GridSnapshot>
+    {
+        size_t operator()(const GridSnapshot& snapshot) const { return snapshot.hash(); }
+    };
+}
+
+#endif /* GridSnapshot_hpp */
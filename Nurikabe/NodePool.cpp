@@ -0,0 +1,53 @@
+//
+//  NodePool.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "NodePool.hpp"
+#include <new>
+
+using namespace std;
+
+constexpr size_t NodePool::granularity;
+constexpr size_t NodePool::maxPooledBytes;
+constexpr size_t NodePool::chunkSize;
+
+void* NodePool::allocate(size_t bytes)
+{
+    if (bytes > maxPooledBytes) { return ::operator new(bytes); }
+    
+    const size_t sizeIndex = sizeClass(bytes);
+    if (FreeBlock* block = freeLists[sizeIndex])
+    {
+        freeLists[sizeIndex] = block->next;
+        return block;
+    }
+    
+    // Carve a new block off the current chunk, the leftover tail of a full chunk is simply abandoned
+    const size_t blockBytes = sizeIndex * granularity;
+    if (chunkCursor == nullptr || static_cast<size_t>(chunkEnd - chunkCursor) < blockBytes)
+    {
+        chunks.push_back(unique_ptr<char[]>(new char[chunkSize]));
+        chunkCursor = chunks.back().get();
+        chunkEnd = chunkCursor + chunkSize;
+    }
+    void* block = chunkCursor;
+    chunkCursor += blockBytes;
+    return block;
+}
+
+void NodePool::deallocate(void* block, size_t bytes)
+{
+    if (bytes > maxPooledBytes)
+    {
+        ::operator delete(block);
+        return;
+    }
+    
+    const size_t sizeIndex = sizeClass(bytes);
+    auto freeBlock = static_cast<FreeBlock*>(block);
+    freeBlock->next = freeLists[sizeIndex];
+    freeLists[sizeIndex] = freeBlock;
+}
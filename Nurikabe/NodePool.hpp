@@ -0,0 +1,78 @@
+//
+//  NodePool.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef NodePool_hpp
+#define NodePool_hpp
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/// An arena for the small fixed size blocks that node based containers allocate one at a time.
+/// Freed blocks go onto a free list for their size and are handed out again, the memory itself is only returned when the pool is destroyed,
+/// so once a pool has grown to the peak number of nodes a workload needs it never touches the heap again.
+/// A pool is not thread safe, every Grid owns its own.
+class NodePool
+{
+public:
+    NodePool() = default;
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+    
+    void* allocate(size_t bytes);
+    void deallocate(void* block, size_t bytes);
+    
+    /// The number of bytes of chunk memory the pool has taken from the heap
+    size_t reservedBytes() const { return chunks.size() * chunkSize; };
+
+private:
+    static constexpr size_t granularity = alignof(std::max_align_t);
+    /// Blocks bigger than this come straight from the heap, the nodes of a std::set of small values are well under it
+    static constexpr size_t maxPooledBytes = 128;
+    static constexpr size_t chunkSize = 16384;
+    
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+    
+    static size_t sizeClass(size_t bytes) { return (bytes + granularity - 1) / granularity; };
+    
+    FreeBlock* freeLists[maxPooledBytes / granularity + 1] = {};
+    std::vector<std::unique_ptr<char[]>> chunks;
+    /// The unused tail of the newest chunk
+    char* chunkCursor = nullptr;
+    char* chunkEnd = nullptr;
+};
+
+/// A standard allocator that takes its memory from a NodePool. Containers that share a pool can swap and move their contents freely.
+template <typename T>
+struct PoolAllocator
+{
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    
+    PoolAllocator(NodePool& aPool): pool(&aPool) {};
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& allocator): pool(allocator.pool) {};
+    
+    T* allocate(size_t count) { return static_cast<T*>(pool->allocate(count * sizeof(T))); };
+    void deallocate(T* block, size_t count) { pool->deallocate(block, count * sizeof(T)); };
+    
+    NodePool* pool;
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) { return lhs.pool == rhs.pool; }
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) { return lhs.pool != rhs.pool; }
+
+#endif /* NodePool_hpp */
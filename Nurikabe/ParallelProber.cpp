@@ -0,0 +1,73 @@
+//
+//  ParallelProber.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "ParallelProber.hpp"
+
+using namespace std;
+
+ParallelProber::ParallelProber(unsigned threadCount):
+consistent(true),
+pool(threadCount)
+{
+    workers.resize(pool.threadCount());
+    for (auto& worker : workers)
+    {
+        // The worker grids only ever probe the chunks they are given
+        worker.grid.reset(new Grid(1, 1));
+    }
+    split.probe = [this] (const Grid& grid, const vector<int>& cellIndices, vector<Grid::ForcedCell>& forced) { return probe(grid, cellIndices, forced); };
+}
+
+bool ParallelProber::probe(const Grid& grid, const vector<int>& cellIndices, vector<Grid::ForcedCell>& forced)
+{
+    lock_guard<mutex> passLock(passMutex);
+    grid.saveSnapshot(state);
+    fixedGeometry = grid.fixedGeometryEnabled;
+    pass++;
+    consistent = true;
+    passForced = &forced;
+    
+    // A few chunks per worker so that a worker that gets cheap cells can steal from one that got expensive ones
+    const size_t chunkCount = min(cellIndices.size(), static_cast<size_t>(4 * pool.threadCount()));
+    for (size_t chunk = 0; chunk < chunkCount; chunk++)
+    {
+        const size_t begin = chunk * cellIndices.size() / chunkCount;
+        const size_t end = (chunk + 1) * cellIndices.size() / chunkCount;
+        pool.submit([this, &cellIndices, begin, end] (unsigned workerIndex) { probeChunk(workerIndex, cellIndices, begin, end); });
+    }
+    pool.wait();
+    
+    passForced = nullptr;
+    return consistent;
+}
+
+void ParallelProber::probeChunk(unsigned workerIndex, const vector<int>& cellIndices, size_t begin, size_t end)
+{
+    if (!consistent.load(memory_order_relaxed)) { return; }
+    
+    auto& worker = workers[workerIndex];
+    auto& grid = *worker.grid;
+    if (worker.pass != pass)
+    {
+        // The rebuilt grid has to be back at a fixpoint before probing, the rules can only find more than the caller's grid knew which is still sound
+        worker.pass = pass;
+        grid.loadSnapshot(state);
+        grid.fixedGeometryEnabled = fixedGeometry;
+        if (grid.solve() == Grid::Result::Contradiction)
+        {
+            consistent = false;
+            return;
+        }
+    }
+    
+    worker.forced.clear();
+    worker.cellIndices.assign(cellIndices.begin() + begin, cellIndices.begin() + end);
+    if (!grid.probeCells(worker.cellIndices, worker.forced)) { consistent = false; }
+    
+    lock_guard<mutex> lock(forcedMutex);
+    passForced->insert(passForced->end(), worker.forced.begin(), worker.forced.end());
+}
@@ -0,0 +1,72 @@
+//
+//  ParallelProber.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef ParallelProber_hpp
+#define ParallelProber_hpp
+
+#include "Grid.hpp"
+#include "GridSnapshot.hpp"
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// Runs the probing stage of a grid on every core. Every probe starts from the same state so the cells to probe are split into chunks that the workers of a thread pool probe on their own private grids.
+///
+/// - Discussion: Call attach to make a grid use the prober, the grid still has to have Grid::probingEnabled set. A worker rebuilds its grid from a snapshot of the caller's grid once per probing pass
+/// and then probes every chunk it picks up against it, the forced cells of every chunk are handed back to the caller's grid.
+class ParallelProber
+{
+public:
+    /// - Parameters:
+    ///     - threadCount: The number of worker threads, 0 uses one per hardware thread
+    explicit ParallelProber(unsigned threadCount = 0);
+    
+    ParallelProber(const ParallelProber&) = delete;
+    ParallelProber& operator=(const ParallelProber&) = delete;
+    
+    /// Makes grid hand its probing to this prober, see Grid::setProbeSplit. Several grids can be attached, e.g. the worker grids of ParallelSearch, their probing passes take turns.
+    void attach(Grid& grid) { grid.setProbeSplit(&split); };
+    
+    unsigned threadCount() const { return pool.threadCount(); };
+
+private:
+    struct Worker
+    {
+        std::unique_ptr<Grid> grid;
+        /// The probing pass the grid was last rebuilt for
+        long pass = -1;
+        /// The chunk being probed and what it forced, kept between chunks so probing doesn't allocate
+        std::vector<int> cellIndices;
+        std::vector<Grid::ForcedCell> forced;
+    };
+    
+    bool probe(const Grid& grid, const std::vector<int>& cellIndices, std::vector<Grid::ForcedCell>& forced);
+    void probeChunk(unsigned workerIndex, const std::vector<int>& cellIndices, size_t begin, size_t end);
+    
+    std::vector<Worker> workers;
+    Grid::ProbeSplit split;
+    
+    // Held for a whole probing pass so that only one attached grid probes at a time
+    std::mutex passMutex;
+    /// The state the workers probe from and the settings of the grid it came from, only written between passes
+    GridSnapshot state;
+    bool fixedGeometry = true;
+    long pass = 0;
+    /// Cleared as soon as a worker finds a cell with no colour left, the remaining chunks are skipped
+    std::atomic<bool> consistent;
+    
+    // Guards the forced cells of the caller while workers hand theirs back
+    std::mutex forcedMutex;
+    std::vector<Grid::ForcedCell>* passForced = nullptr;
+    
+    // Declared last so that it is destroyed first, the workers have to stop before the grids they use go away
+    ThreadPool pool;
+};
+
+#endif /* ParallelProber_hpp */
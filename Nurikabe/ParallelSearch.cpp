@@ -0,0 +1,130 @@
+//
+//  ParallelSearch.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "ParallelSearch.hpp"
+#include <cassert>
+#include <chrono>
+
+using namespace std;
+
+ParallelSearch::ParallelSearch(unsigned threadCount):
+stopping(false),
+queuedStates(0),
+solutionCount(0),
+pool(threadCount)
+{
+    for (unsigned i = 0; i < pool.threadCount(); i++)
+    {
+        grids.push_back(unique_ptr<Grid>(new Grid(1, 1)));
+        grids.back()->setSearchSplit(&split);
+    }
+    
+    split.cancelled = &stopping;
+    // A single worker has nobody to give work to. Keeping one state queued per worker means a worker that runs out finds one straight away.
+    const int maxQueued = static_cast<int>(pool.threadCount());
+    split.wantsWork = [this, maxQueued] { return maxQueued > 1 && queuedStates.load(memory_order_relaxed) < maxQueued; };
+    split.donate = [this] (const Grid& grid, int cellIndex, bool black) {
+        auto state = make_shared<GridSnapshot>();
+        grid.saveSnapshot(*state);
+        state->setCell(cellIndex % state->width, cellIndex / state->width, black ? GridSnapshot::CellState::Black : GridSnapshot::CellState::White);
+        submit(move(state));
+    };
+}
+
+void ParallelSearch::setTranspositionTable(TranspositionTable* table)
+{
+    for (auto& grid : grids)
+    {
+        grid->setTranspositionTable(table);
+    }
+}
+
+bool ParallelSearch::solve(Grid& grid)
+{
+    run(grid, 0);
+    if (foundSolution) { grid.loadSnapshot(solution); }
+    return foundSolution;
+}
+
+int ParallelSearch::countSolutions(Grid& grid, int limit)
+{
+    limit = max(limit, 1);
+    run(grid, limit);
+    return min(solutionCount.load(), limit);
+}
+
+void ParallelSearch::run(const Grid& grid, int limit)
+{
+    const auto start = chrono::steady_clock::now();
+    solutionLimit = limit;
+    stopping = false;
+    solutionCount = 0;
+    foundSolution = false;
+    lastSearchStats = Grid::SearchStats();
+    lastSolveStats = Grid::SolveStats();
+    tasks = 0;
+    // Only the grid's settings carry over, the split and table stay the ones the workers were set up with
+    callerGrid = &grid;
+    for (auto& workerGrid : grids)
+    {
+        workerGrid->copySettings(grid);
+    }
+    
+    auto root = make_shared<GridSnapshot>();
+    grid.saveSnapshot(*root);
+    submit(move(root));
+    pool.wait();
+    
+    callerGrid = nullptr;
+    lastSearchStats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void ParallelSearch::submit(shared_ptr<GridSnapshot> state)
+{
+    queuedStates++;
+    pool.submit([this, state] (unsigned workerIndex) {
+        queuedStates--;
+        // States handed off before the search stopped are dropped without being looked at
+        if (!stopping.load(memory_order_relaxed)) { searchState(workerIndex, *state); }
+    });
+}
+
+void ParallelSearch::searchState(unsigned workerIndex, const GridSnapshot& state)
+{
+    auto& grid = *grids[workerIndex];
+    grid.loadSnapshot(state);
+    // Rebuilding the grid mustn't lose the settings run copied, the workers would search differently from the caller's grid without anything showing it
+    assert(grid.hasSameSettings(*callerGrid));
+    
+    bool solved = false;
+    int count = 0;
+    if (solutionLimit == 0)
+    {
+        solved = grid.solveWithSearch();
+        if (solved) { stopping = true; }
+    }
+    else
+    {
+        // Every task searches a different part of the tree so the solutions the tasks find are all different
+        count = grid.countSolutions(solutionLimit);
+        if (solutionCount.fetch_add(count) + count >= solutionLimit) { stopping = true; }
+    }
+    
+    lock_guard<mutex> lock(resultMutex);
+    if (solved && !foundSolution)
+    {
+        foundSolution = true;
+        grid.saveSnapshot(solution);
+    }
+    const auto& stats = grid.searchStats();
+    lastSearchStats.nodes += stats.nodes;
+    lastSearchStats.backtracks += stats.backtracks;
+    lastSearchStats.tableProbes += stats.tableProbes;
+    lastSearchStats.tableHits += stats.tableHits;
+    lastSolveStats.add(grid.solveStats());
+    tasks++;
+}
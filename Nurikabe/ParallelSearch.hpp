@@ -0,0 +1,85 @@
+//
+//  ParallelSearch.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef ParallelSearch_hpp
+#define ParallelSearch_hpp
+
+#include "Grid.hpp"
+#include "GridSnapshot.hpp"
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// Searches a single grid on every core by splitting its search tree between the workers of a work stealing thread pool.
+///
+/// - Discussion: Every worker owns a private Grid. A task is a snapshot of a search state, the worker rebuilds its grid from the snapshot and runs the normal search from there.
+/// While fewer states are queued than there are workers, a worker that reaches a branch hands the second colour of the branch to the pool as a new task and carries on with the first,
+/// so big subtrees are split near the root and small ones stay on the worker that found them. Once the first solution or enough solutions have been found every worker is told to stop.
+class ParallelSearch
+{
+public:
+    /// - Parameters:
+    ///     - threadCount: The number of worker threads, 0 uses one per hardware thread
+    explicit ParallelSearch(unsigned threadCount = 0);
+    
+    ParallelSearch(const ParallelSearch&) = delete;
+    ParallelSearch& operator=(const ParallelSearch&) = delete;
+    
+    /// The parallel version of Grid::solveWithSearch, the grid is left solved if a solution was found and unchanged otherwise.
+    /// The workers search with the grid's settings, see Grid::copySettings.
+    ///
+    /// - Returns: true if the grid was solved, false if the puzzle has no solution
+    bool solve(Grid& grid);
+    
+    /// The parallel version of Grid::countSolutions, the grid is left unchanged
+    int countSolutions(Grid& grid, int limit);
+    
+    /// Shared by the grids of every worker, see Grid::setTranspositionTable
+    void setTranspositionTable(TranspositionTable* table);
+    
+    /// The totals of every worker for the last search, seconds is the wall clock time
+    const Grid::SearchStats& searchStats() const { return lastSearchStats; };
+    /// The totals of the rule stats of every worker for the last search, the grid that is passed to solve is rebuilt from the solution so its own stats are lost
+    const Grid::SolveStats& solveStats() const { return lastSolveStats; };
+    /// The number of states that were searched as separate tasks in the last search, including the root
+    long taskCount() const { return tasks; };
+    
+    unsigned threadCount() const { return pool.threadCount(); };
+
+private:
+    /// Runs the search from the root state of grid until the workers are done, solution limit is 0 to find one solution
+    void run(const Grid& grid, int limit);
+    void submit(std::shared_ptr<GridSnapshot> state);
+    void searchState(unsigned workerIndex, const GridSnapshot& state);
+    
+    /// One grid per worker, only ever touched by the worker with the same index
+    std::vector<std::unique_ptr<Grid>> grids;
+    Grid::SearchSplit split;
+    
+    int solutionLimit = 0;
+    /// The grid passed to solve or countSolutions while the workers search it
+    const Grid* callerGrid = nullptr;
+    std::atomic<bool> stopping;
+    /// States that have been submitted but not picked up by a worker yet
+    std::atomic<int> queuedStates;
+    std::atomic<int> solutionCount;
+    
+    // Guards everything below
+    std::mutex resultMutex;
+    bool foundSolution = false;
+    GridSnapshot solution;
+    Grid::SearchStats lastSearchStats;
+    Grid::SolveStats lastSolveStats;
+    long tasks = 0;
+    
+    // Declared last so that it is destroyed first, the workers have to stop before the grids they use go away
+    ThreadPool pool;
+};
+
+#endif /* ParallelSearch_hpp */
@@ -0,0 +1,578 @@
+//
+//  SatBackend.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "SatBackend.hpp"
+#include "Corpus.hpp"
+#include "Grid.hpp"
+#include <algorithm>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace
+{
+    /// Fills neighbours with the cells next to cell
+    ///
+    /// - Returns: How many neighbours there are
+    int neighboursOf(int cell, int width, int height, int neighbours[4])
+    {
+        const int x = cell % width;
+        const int y = cell / width;
+        int count = 0;
+        if (x > 0) { neighbours[count++] = cell - 1; }
+        if (x < width - 1) { neighbours[count++] = cell + 1; }
+        if (y > 0) { neighbours[count++] = cell - width; }
+        if (y < height - 1) { neighbours[count++] = cell + width; }
+        return count;
+    }
+}
+
+bool BackendPolicy::usesSat(const CorpusPuzzle& puzzle) const
+{
+    switch (backend) {
+        case SolverBackend::Search:
+            return false;
+        case SolverBackend::Sat:
+            return true;
+        case SolverBackend::Auto:
+            return puzzle.width * puzzle.height >= minimumCells && (difficulty.empty() || puzzle.difficulty == difficulty);
+    }
+    return false;
+}
+
+bool BackendPolicy::parseBackend(const string& name, SolverBackend& backend)
+{
+    if (name == "search") { backend = SolverBackend::Search; }
+    else if (name == "sat") { backend = SolverBackend::Sat; }
+    else if (name == "auto") { backend = SolverBackend::Auto; }
+    else { return false; }
+    return true;
+}
+
+const char* BackendPolicy::backendName(SolverBackend backend)
+{
+    switch (backend) {
+        case SolverBackend::Search:
+            return "search";
+        case SolverBackend::Sat:
+            return "sat";
+        case SolverBackend::Auto:
+            return "auto";
+    }
+    return "";
+}
+
+bool SatBackend::solve(Grid& grid)
+{
+    const auto start = steady_clock::now();
+    lastStats = Stats();
+    
+    const Grid::Result result = grid.solve();
+    if (result != Grid::Result::Stuck)
+    {
+        lastStats.solvedByRules = true;
+        lastStats.time = duration_cast<microseconds>(steady_clock::now() - start);
+        return result == Grid::Result::Solved;
+    }
+    
+    grid.saveSnapshot(snapshot);
+    width = snapshot.width;
+    height = snapshot.height;
+    colours.resize(width * height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            colours[y * width + x] = static_cast<uint8_t>(snapshot.cell(x, y));
+        }
+    }
+    clueCells.clear();
+    clueNumbers.clear();
+    for (const auto& clue : snapshot.clues)
+    {
+        clueCells.push_back(clue.index);
+        clueNumbers.push_back(clue.number);
+    }
+    
+    // decided is set once the SAT solver has an answer that can be trusted, otherwise search finishes the grid
+    bool decided = false;
+    bool solved = false;
+    if (!encode())
+    {
+        decided = true;
+    }
+    else
+    {
+        while (true)
+        {
+            const long conflictsLeft = conflictLimit - solver.stats().conflicts;
+            if (conflictsLeft <= 0) { break; }
+            
+            const SatSolver::Result satResult = solver.solve(conflictsLeft);
+            if (satResult == SatSolver::Result::Unknown) { break; }
+            if (satResult == SatSolver::Result::Unsatisfiable)
+            {
+                decided = true;
+                break;
+            }
+            
+            lastStats.rounds++;
+            const int cuts = addConnectivityCuts();
+            if (cuts < 0)
+            {
+                // A cut made the clauses unsatisfiable so no model is connected, the puzzle has no solution
+                decided = true;
+                break;
+            }
+            if (cuts == 0)
+            {
+                decided = true;
+                solved = true;
+                break;
+            }
+        }
+    }
+    lastStats.variables = solver.variableCount();
+    lastStats.clauses = solver.problemClauseCount();
+    lastStats.conflicts = solver.stats().conflicts;
+    lastStats.decisions = solver.stats().decisions;
+    
+    if (solved)
+    {
+        for (int cell = 0; cell < width * height; cell++)
+        {
+            snapshot.setCell(cell % width, cell / width, solver.modelValue(cell) ? GridSnapshot::CellState::Black : GridSnapshot::CellState::White);
+        }
+        // The model is checked rather than trusted, a solution that breaks a rule would point to a bug in the encoding so let search have the grid instead
+        if (verifier.verify(snapshot) == SolutionVerifier::Failure::None)
+        {
+            grid.loadSnapshot(snapshot);
+        }
+        else
+        {
+            decided = false;
+        }
+    }
+    if (!decided)
+    {
+        lastStats.fellBack = true;
+        solved = grid.solveWithSearch();
+    }
+    
+    lastStats.time = duration_cast<microseconds>(steady_clock::now() - start);
+    return solved;
+}
+
+bool SatBackend::addClause()
+{
+    return solver.addClause(clause);
+}
+
+bool SatBackend::encode()
+{
+    const int cellCount = width * height;
+    solver.clear();
+    
+    // The first cellCount variables are the cell colours so a cell's variable is its index
+    for (int cell = 0; cell < cellCount; cell++)
+    {
+        solver.addVariable();
+    }
+    for (int cell = 0; cell < cellCount; cell++)
+    {
+        if (colours[cell] == Unknown) { continue; }
+        clause.assign(1, blackLiteral(cell, colours[cell] == Black));
+        if (!addClause()) { return false; }
+    }
+    
+    if (!encodeIslands()) { return false; }
+    
+    // Likewise a black cell has a black neighbour unless it is the only black cell
+    int blackCount = cellCount;
+    for (const int number : clueNumbers) { blackCount -= number; }
+    int neighbours[4];
+    for (int cell = 0; blackCount > 1 && cell < cellCount; cell++)
+    {
+        const int count = neighboursOf(cell, width, height, neighbours);
+        clause.assign(1, blackLiteral(cell, false));
+        for (int i = 0; i < count; i++) { clause.push_back(blackLiteral(neighbours[i], true)); }
+        if (!addClause()) { return false; }
+    }
+    
+    for (int y = 0; y < height - 1; y++)
+    {
+        for (int x = 0; x < width - 1; x++)
+        {
+            const int cell = y * width + x;
+            clause.clear();
+            clause.push_back(blackLiteral(cell, false));
+            clause.push_back(blackLiteral(cell + 1, false));
+            clause.push_back(blackLiteral(cell + width, false));
+            clause.push_back(blackLiteral(cell + width + 1, false));
+            if (!addClause()) { return false; }
+        }
+    }
+    return true;
+}
+
+bool SatBackend::encodeIslands()
+{
+    const int cellCount = width * height;
+    const int clueCount = static_cast<int>(clueCells.size());
+    int neighbours[4];
+    
+    // The white cells already joined to each numbered cell are in its island for certain
+    owners.assign(cellCount, -1);
+    for (int clue = 0; clue < clueCount; clue++)
+    {
+        queue.assign(1, clueCells[clue]);
+        owners[clueCells[clue]] = clue;
+        for (size_t head = 0; head < queue.size(); head++)
+        {
+            const int count = neighboursOf(queue[head], width, height, neighbours);
+            for (int i = 0; i < count; i++)
+            {
+                const int neighbour = neighbours[i];
+                if (colours[neighbour] != White || owners[neighbour] == clue) { continue; }
+                if (owners[neighbour] != -1) { return false; }
+                owners[neighbour] = clue;
+                queue.push_back(neighbour);
+            }
+        }
+        if (static_cast<int>(queue.size()) > clueNumbers[clue]) { return false; }
+    }
+    
+    candidates.clear();
+    clueCandidateStart.clear();
+    candidateClues.assign(cellCount, -1);
+    candidateVariables.assign(cellCount, -1);
+    distances.assign(cellCount, -1);
+    for (int clue = 0; clue < clueCount; clue++)
+    {
+        clueCandidateStart.push_back(static_cast<int>(candidates.size()));
+        
+        // The owned cells are all at distance 0, then a breadth first search finds every cell that the cells still to be added could reach.
+        // Cells that are black, belong to another island or touch another island are never in this one.
+        queue.assign(1, clueCells[clue]);
+        distances[clueCells[clue]] = 0;
+        for (size_t head = 0; head < queue.size(); head++)
+        {
+            const int count = neighboursOf(queue[head], width, height, neighbours);
+            for (int i = 0; i < count; i++)
+            {
+                if (owners[neighbours[i]] == clue && distances[neighbours[i]] == -1)
+                {
+                    distances[neighbours[i]] = 0;
+                    queue.push_back(neighbours[i]);
+                }
+            }
+        }
+        const int ownedCount = static_cast<int>(queue.size());
+        const int cellsLeft = clueNumbers[clue] - ownedCount;
+        for (size_t head = 0; head < queue.size(); head++)
+        {
+            const int cell = queue[head];
+            if (distances[cell] >= cellsLeft) { continue; }
+            
+            const int count = neighboursOf(cell, width, height, neighbours);
+            for (int i = 0; i < count; i++)
+            {
+                const int neighbour = neighbours[i];
+                if (distances[neighbour] != -1 || colours[neighbour] == Black || owners[neighbour] != -1) { continue; }
+                
+                int nextTo[4];
+                const int nextToCount = neighboursOf(neighbour, width, height, nextTo);
+                bool touchesOtherIsland = false;
+                for (int j = 0; j < nextToCount; j++)
+                {
+                    if (owners[nextTo[j]] != -1 && owners[nextTo[j]] != clue) { touchesOtherIsland = true; }
+                }
+                if (touchesOtherIsland) { continue; }
+                
+                distances[neighbour] = distances[cell] + 1;
+                queue.push_back(neighbour);
+            }
+        }
+        
+        const int firstCandidate = static_cast<int>(candidates.size());
+        freeVariables.clear();
+        for (size_t i = 0; i < queue.size(); i++)
+        {
+            const int cell = queue[i];
+            distances[cell] = -1;
+            const int variable = solver.addVariable();
+            const bool owned = static_cast<int>(i) < ownedCount;
+            candidates.push_back({cell, variable, owned});
+            candidateClues[cell] = clue;
+            candidateVariables[cell] = variable;
+            if (owned)
+            {
+                clause.assign(1, SatSolver::literal(variable, true));
+                if (!addClause()) { return false; }
+            }
+            else
+            {
+                freeVariables.push_back(variable);
+                clause.assign({SatSolver::literal(variable, false), blackLiteral(cell, false)});
+                if (!addClause()) { return false; }
+            }
+        }
+        
+        // An island takes in every white neighbour of its cells
+        for (size_t i = firstCandidate; i < candidates.size(); i++)
+        {
+            const Candidate candidate = candidates[i];
+            const int count = neighboursOf(candidate.cell, width, height, neighbours);
+            for (int j = 0; j < count; j++)
+            {
+                const int neighbour = neighbours[j];
+                if (colours[neighbour] == Black || owners[neighbour] == clue) { continue; }
+                
+                clause.assign({SatSolver::literal(candidate.variable, false), blackLiteral(neighbour, true)});
+                if (candidateClues[neighbour] == clue) { clause.push_back(SatSolver::literal(candidateVariables[neighbour], true)); }
+                if (!addClause()) { return false; }
+            }
+            
+            // ...and a cell other than the numbered cell has a neighbour in the same island, which rules out the smallest cut off parts before any cuts are needed
+            if (candidate.cell == clueCells[clue]) { continue; }
+            clause.assign(1, SatSolver::literal(candidate.variable, false));
+            for (int j = 0; j < count; j++)
+            {
+                if (candidateClues[neighbours[j]] == clue) { clause.push_back(SatSolver::literal(candidateVariables[neighbours[j]], true)); }
+            }
+            if (!addClause()) { return false; }
+        }
+        
+        if (!encodeExactly(freeVariables, cellsLeft)) { return false; }
+    }
+    clueCandidateStart.push_back(static_cast<int>(candidates.size()));
+    
+    // Group the candidates by cell with a counting sort
+    cellCandidateStart.assign(cellCount + 1, 0);
+    for (const auto& candidate : candidates)
+    {
+        cellCandidateStart[candidate.cell + 1]++;
+    }
+    for (int cell = 0; cell < cellCount; cell++)
+    {
+        cellCandidateStart[cell + 1] += cellCandidateStart[cell];
+    }
+    cellCandidates.resize(candidates.size());
+    distances.assign(cellCandidateStart.begin(), cellCandidateStart.end() - 1);
+    for (int i = 0; i < static_cast<int>(candidates.size()); i++)
+    {
+        cellCandidates[distances[candidates[i].cell]++] = i;
+    }
+    distances.assign(cellCount, -1);
+    
+    // A cell that isn't black is in exactly one island, so a cell that no island can reach is black
+    for (int cell = 0; cell < cellCount; cell++)
+    {
+        if (colours[cell] == Black || owners[cell] != -1) { continue; }
+        
+        clause.assign(1, blackLiteral(cell, true));
+        for (int i = cellCandidateStart[cell]; i < cellCandidateStart[cell + 1]; i++)
+        {
+            clause.push_back(SatSolver::literal(candidates[cellCandidates[i]].variable, true));
+        }
+        if (!addClause()) { return false; }
+        
+        for (int i = cellCandidateStart[cell]; i < cellCandidateStart[cell + 1]; i++)
+        {
+            for (int j = i + 1; j < cellCandidateStart[cell + 1]; j++)
+            {
+                clause.assign({SatSolver::literal(candidates[cellCandidates[i]].variable, false), SatSolver::literal(candidates[cellCandidates[j]].variable, false)});
+                if (!addClause()) { return false; }
+            }
+        }
+    }
+    return true;
+}
+
+bool SatBackend::encodeExactly(const vector<int>& variables, int count)
+{
+    const int variableCount = static_cast<int>(variables.size());
+    if (count > variableCount) { return false; }
+    if (count == 0 || count == variableCount)
+    {
+        for (const int variable : variables)
+        {
+            clause.assign(1, SatSolver::literal(variable, count != 0));
+            if (!addClause()) { return false; }
+        }
+        return true;
+    }
+    
+    // counter(i, j) is true exactly when at least j of the first i + 1 variables are true, for j from 1 to count + 1
+    const int columns = count + 1;
+    counterVariables.resize(variableCount * columns);
+    for (auto& variable : counterVariables)
+    {
+        variable = solver.addVariable();
+    }
+    auto counter = [this, columns](int i, int j, bool value) { return SatSolver::literal(counterVariables[i * columns + j - 1], value); };
+    
+    const SatSolver::Literal first = SatSolver::literal(variables[0], true);
+    clause.assign({SatSolver::negation(first), counter(0, 1, true)});
+    if (!addClause()) { return false; }
+    clause.assign({first, counter(0, 1, false)});
+    if (!addClause()) { return false; }
+    for (int j = 2; j <= columns; j++)
+    {
+        clause.assign(1, counter(0, j, false));
+        if (!addClause()) { return false; }
+    }
+    
+    for (int i = 1; i < variableCount; i++)
+    {
+        const SatSolver::Literal literal = SatSolver::literal(variables[i], true);
+        for (int j = 1; j <= columns; j++)
+        {
+            // At least j of the first i + 1 follows from at least j of the first i, or at least j - 1 of them and this one
+            clause.assign({counter(i - 1, j, false), counter(i, j, true)});
+            if (!addClause()) { return false; }
+            clause.assign({SatSolver::negation(literal), counter(i, j, true)});
+            if (j > 1) { clause.push_back(counter(i - 1, j - 1, false)); }
+            if (!addClause()) { return false; }
+            
+            // ...and nothing else makes it true
+            clause.assign({counter(i, j, false), counter(i - 1, j, true), literal});
+            if (!addClause()) { return false; }
+            if (j > 1)
+            {
+                clause.assign({counter(i, j, false), counter(i - 1, j, true), counter(i - 1, j - 1, true)});
+                if (!addClause()) { return false; }
+            }
+        }
+    }
+    
+    clause.assign(1, counter(variableCount - 1, count, true));
+    if (!addClause()) { return false; }
+    clause.assign(1, counter(variableCount - 1, count + 1, false));
+    return addClause();
+}
+
+int SatBackend::addConnectivityCuts()
+{
+    const int cutsBefore = lastStats.cuts;
+    components.assign(width * height, 0);
+    componentCount = 0;
+    for (int clue = 0; clue < static_cast<int>(clueCells.size()); clue++)
+    {
+        if (!addIslandCuts(clue)) { return -1; }
+    }
+    if (!addBlackCuts()) { return -1; }
+    return lastStats.cuts - cutsBefore;
+}
+
+bool SatBackend::addIslandCuts(int clue)
+{
+    // Every island cell is in one island only so the component numbers can be shared between islands and the black regions
+    for (int i = clueCandidateStart[clue]; i < clueCandidateStart[clue + 1]; i++)
+    {
+        candidateClues[candidates[i].cell] = clue;
+        candidateVariables[candidates[i].cell] = candidates[i].variable;
+    }
+    auto inIsland = [this, clue](int cell) { return candidateClues[cell] == clue && solver.modelValue(candidateVariables[cell]); };
+    
+    int neighbours[4];
+    for (int i = clueCandidateStart[clue]; i < clueCandidateStart[clue + 1]; i++)
+    {
+        const int start = candidates[i].cell;
+        if (components[start] != 0 || !inIsland(start)) { continue; }
+        
+        // The candidates start with the numbered cell so the first part found is the one that holds it and every other part is cut off
+        const int componentIndex = ++componentCount;
+        components[start] = componentIndex;
+        component.assign(1, start);
+        for (size_t head = 0; head < component.size(); head++)
+        {
+            const int count = neighboursOf(component[head], width, height, neighbours);
+            for (int j = 0; j < count; j++)
+            {
+                if (components[neighbours[j]] == 0 && inIsland(neighbours[j]))
+                {
+                    components[neighbours[j]] = componentIndex;
+                    component.push_back(neighbours[j]);
+                }
+            }
+        }
+        if (start == clueCells[clue]) { continue; }
+        
+        // A part of an island without its numbered cell has to reach past its border, which is all black
+        clause.clear();
+        for (const int cell : component)
+        {
+            clause.push_back(SatSolver::literal(candidateVariables[cell], false));
+            const int count = neighboursOf(cell, width, height, neighbours);
+            for (int j = 0; j < count; j++)
+            {
+                if (components[neighbours[j]] != componentIndex) { clause.push_back(blackLiteral(neighbours[j], false)); }
+            }
+        }
+        lastStats.cuts++;
+        if (!addClause()) { return false; }
+    }
+    return true;
+}
+
+bool SatBackend::addBlackCuts()
+{
+    // Find every black region first, the cells of region i are blackCells[regionStarts[i]] up to blackCells[regionStarts[i + 1]]
+    blackCells.clear();
+    regionStarts.clear();
+    int neighbours[4];
+    for (int start = 0; start < width * height; start++)
+    {
+        if (components[start] != 0 || !solver.modelValue(start)) { continue; }
+        
+        const int componentIndex = ++componentCount;
+        components[start] = componentIndex;
+        regionStarts.push_back(static_cast<int>(blackCells.size()));
+        blackCells.push_back(start);
+        for (size_t head = regionStarts.back(); head < blackCells.size(); head++)
+        {
+            const int count = neighboursOf(blackCells[head], width, height, neighbours);
+            for (int j = 0; j < count; j++)
+            {
+                if (components[neighbours[j]] == 0 && solver.modelValue(neighbours[j]))
+                {
+                    components[neighbours[j]] = componentIndex;
+                    blackCells.push_back(neighbours[j]);
+                }
+            }
+        }
+    }
+    if (regionStarts.size() < 2) { return true; }
+    regionStarts.push_back(static_cast<int>(blackCells.size()));
+    
+    // With more than one region none of them is all of the black cells, so a region that only has white cells around it can't be part of a solution.
+    // The biggest region is left out, its clause would be long and slow down propagation while the cuts of the others already rule the model out.
+    size_t largest = 0;
+    for (size_t region = 1; region + 1 < regionStarts.size(); region++)
+    {
+        if (regionStarts[region + 1] - regionStarts[region] > regionStarts[largest + 1] - regionStarts[largest]) { largest = region; }
+    }
+    for (size_t region = 0; region + 1 < regionStarts.size(); region++)
+    {
+        if (region == largest) { continue; }
+        clause.clear();
+        for (int i = regionStarts[region]; i < regionStarts[region + 1]; i++)
+        {
+            const int cell = blackCells[i];
+            clause.push_back(blackLiteral(cell, false));
+            const int count = neighboursOf(cell, width, height, neighbours);
+            for (int j = 0; j < count; j++)
+            {
+                if (!solver.modelValue(neighbours[j])) { clause.push_back(blackLiteral(neighbours[j], true)); }
+            }
+        }
+        lastStats.cuts++;
+        if (!addClause()) { return false; }
+    }
+    return true;
+}
@@ -0,0 +1,153 @@
+//
+//  SatBackend.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef SatBackend_hpp
+#define SatBackend_hpp
+
+#include "GridSnapshot.hpp"
+#include "SatSolver.hpp"
+#include "SolutionVerifier.hpp"
+#include <chrono>
+#include <string>
+#include <vector>
+
+class Grid;
+struct CorpusPuzzle;
+
+/// Which solver finishes a grid once the deduction rules are stuck
+enum class SolverBackend
+{
+    Search,     // Grid::solveWithSearch
+    Sat,        // SatBackend
+    Auto        // Chosen per puzzle by BackendPolicy
+};
+
+/// Decides which backend solves each puzzle of a corpus
+struct BackendPolicy
+{
+    SolverBackend backend = SolverBackend::Search;
+    /// With Auto a puzzle goes to the SAT backend when it has at least this many cells and its difficulty matches.
+    /// Below this size search is cheap enough that building the clauses costs more than it saves.
+    int minimumCells = 400;
+    /// With Auto only puzzles of this difficulty go to the SAT backend, empty for any difficulty
+    std::string difficulty = "hard";
+    
+    bool usesSat(const CorpusPuzzle& puzzle) const;
+    
+    /// Reads search, sat or auto
+    ///
+    /// - Returns: false if the name isn't one of them
+    static bool parseBackend(const std::string& name, SolverBackend& backend);
+    static const char* backendName(SolverBackend backend);
+};
+
+/// Solves a grid by encoding whatever the deduction rules leave unknown as a SAT problem and handing it to SatSolver.
+///
+/// - Discussion: Every cell has a variable that is true when the cell is black and every pairing of a numbered cell with a cell its island could reach has a variable that is true when
+/// the cell is in that island. Clauses say that a white cell is in exactly one island, that an island spreads to every white neighbour of its cells, that an island has exactly its number of cells
+/// (a sequential counter over the cells it could reach) and that no 2x2 window is black. Connectivity isn't encoded up front: each model is checked and every island part that is cut off from its
+/// numbered cell, and every black region but the biggest, gets a clause saying that it has to grow past its current border, then the solver carries on with what it has learnt.
+/// If the solver runs out of conflicts the grid is handed to Grid::solveWithSearch instead, so the backend never gives a different answer than search, only a different solution of a puzzle that has several.
+class SatBackend
+{
+public:
+    /// Statistics for the last call to solve
+    struct Stats
+    {
+        int variables = 0;
+        long clauses = 0;
+        /// Models that were checked for connectivity
+        int rounds = 0;
+        /// Connectivity clauses added after a model was found to be disconnected
+        int cuts = 0;
+        long conflicts = 0;
+        long decisions = 0;
+        /// True when the rules solved the grid or found it unsolvable so no SAT problem was built
+        bool solvedByRules = false;
+        /// True when the conflict limit was reached and Grid::solveWithSearch finished the grid
+        bool fellBack = false;
+        std::chrono::microseconds time = std::chrono::microseconds(0);
+    };
+    
+    /// Runs the deduction rules on the grid and then solves whatever they leave unknown, the grid is left solved
+    ///
+    /// - Returns: true if the grid was solved, false if the puzzle has no solution
+    bool solve(Grid& grid);
+    
+    const Stats& stats() const { return lastStats; };
+    
+    /// The most conflicts the SAT solver is allowed over all of its rounds before the grid goes to Grid::solveWithSearch
+    long conflictLimit = 200000;
+
+private:
+    enum Colour : uint8_t { Unknown = 0, White = 1, Black = 2 };
+    
+    /// A cell that a numbered cell's island could include
+    struct Candidate
+    {
+        int cell;
+        int variable;
+        /// True for the cells that are already white and joined to the numbered cell
+        bool owned;
+    };
+    
+    /// - Returns: false if the state can't be solved without building any clauses
+    bool encode();
+    /// Finds the cells each island could reach and adds the island clauses
+    bool encodeIslands();
+    /// Adds a sequential counter that makes exactly count of the variables true
+    bool encodeExactly(const std::vector<int>& variables, int count);
+    /// Checks the model and adds a cut for every disconnected island part and black region
+    ///
+    /// - Returns: the number of cuts added, 0 if the model is a solution and -1 if a cut left the clauses unsatisfiable
+    int addConnectivityCuts();
+    /// - Returns: false if a cut left the clauses unsatisfiable
+    bool addIslandCuts(int clue);
+    bool addBlackCuts();
+    
+    SatSolver::Literal blackLiteral(int cell, bool value) const { return SatSolver::literal(cell, value); };
+    bool addClause();
+    
+    SatSolver solver;
+    SolutionVerifier verifier;
+    GridSnapshot snapshot;
+    Stats lastStats;
+    
+    int width = 0;
+    int height = 0;
+    /// The colour of every cell when the rules got stuck, the variable of cell i is i so it is true when the cell is black
+    std::vector<uint8_t> colours = std::vector<uint8_t>();
+    /// The numbered cell of every clue and its number
+    std::vector<int> clueCells = std::vector<int>();
+    std::vector<int> clueNumbers = std::vector<int>();
+    /// The candidates of each clue are candidates[clueCandidateStart[clue]] up to candidates[clueCandidateStart[clue + 1]]
+    std::vector<Candidate> candidates = std::vector<Candidate>();
+    std::vector<int> clueCandidateStart = std::vector<int>();
+    /// The clue whose island a white cell is already part of, -1 otherwise
+    std::vector<int> owners = std::vector<int>();
+    /// The indices into candidates of the candidates of each cell, cellCandidates[cellCandidateStart[cell]] up to cellCandidates[cellCandidateStart[cell + 1]]
+    std::vector<int> cellCandidates = std::vector<int>();
+    std::vector<int> cellCandidateStart = std::vector<int>();
+    /// Lets the variable of a clue and cell be looked up: candidateVariables[cell] is the variable when candidateClues[cell] is the clue being worked on
+    std::vector<int> candidateClues = std::vector<int>();
+    std::vector<int> candidateVariables = std::vector<int>();
+    
+    // Scratch space
+    std::vector<SatSolver::Literal> clause = std::vector<SatSolver::Literal>();
+    std::vector<int> distances = std::vector<int>();
+    std::vector<int> queue = std::vector<int>();
+    std::vector<int> counterVariables = std::vector<int>();
+    std::vector<int> freeVariables = std::vector<int>();
+    /// The component every cell was reached in while checking a model, components are numbered from 1 and never reused within a solve
+    std::vector<int> components = std::vector<int>();
+    int componentCount = 0;
+    std::vector<int> component = std::vector<int>();
+    std::vector<int> blackCells = std::vector<int>();
+    std::vector<int> regionStarts = std::vector<int>();
+};
+
+#endif /* SatBackend_hpp */
@@ -0,0 +1,507 @@
+//
+//  SatSolver.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "SatSolver.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    const double variableDecay = 0.95;
+    const double clauseDecay = 0.999;
+    const double activityLimit = 1e100;
+    /// Conflicts in the first restart interval, the intervals follow the Luby sequence times this
+    const long restartUnit = 100;
+}
+
+void SatSolver::clear()
+{
+    literals.clear();
+    clauses.clear();
+    for (auto& watchList : watches) { watchList.clear(); }
+    problemClauses = 0;
+    learntCount = 0;
+    maxLearnts = 0;
+    unsatisfiable = false;
+    
+    assignments.clear();
+    levels.clear();
+    reasons.clear();
+    polarities.clear();
+    activity.clear();
+    seen.clear();
+    model.clear();
+    variableIncrement = 1;
+    clauseIncrement = 1;
+    
+    heap.clear();
+    heapPositions.clear();
+    trail.clear();
+    trailLimits.clear();
+    propagationHead = 0;
+    solverStats = Stats();
+}
+
+int SatSolver::addVariable()
+{
+    const int variable = variableCount();
+    assignments.push_back(Undefined);
+    levels.push_back(0);
+    reasons.push_back(-1);
+    // Every variable is tried false first until phase saving has remembered something better
+    polarities.push_back(0);
+    activity.push_back(0);
+    seen.push_back(0);
+    model.push_back(0);
+    heapPositions.push_back(-1);
+    // The watch lists are kept after clear so their storage can be reused
+    if (watches.size() < assignments.size() * 2) { watches.resize(assignments.size() * 2); }
+    heapInsert(variable);
+    return variable;
+}
+
+bool SatSolver::addClause(const vector<Literal>& clauseLiterals)
+{
+    if (unsatisfiable) { return false; }
+    
+    // Literals that are already false can't help, a literal that is already true or a literal alongside its negation means the clause is always satisfied
+    addScratch.assign(clauseLiterals.begin(), clauseLiterals.end());
+    sort(addScratch.begin(), addScratch.end());
+    size_t kept = 0;
+    for (size_t i = 0; i < addScratch.size(); i++)
+    {
+        const Literal literal = addScratch[i];
+        if (valueOf(literal) == True || (kept > 0 && addScratch[kept - 1] == negation(literal))) { return true; }
+        if (valueOf(literal) == False || (kept > 0 && addScratch[kept - 1] == literal)) { continue; }
+        addScratch[kept++] = literal;
+    }
+    addScratch.resize(kept);
+    
+    if (addScratch.empty())
+    {
+        unsatisfiable = true;
+        return false;
+    }
+    if (addScratch.size() == 1)
+    {
+        assign(addScratch[0], -1);
+        unsatisfiable = propagate() != -1;
+        return !unsatisfiable;
+    }
+    
+    attachClause(addScratch, false);
+    problemClauses++;
+    return true;
+}
+
+int SatSolver::attachClause(const vector<Literal>& clauseLiterals, bool learnt)
+{
+    const int clauseIndex = static_cast<int>(clauses.size());
+    clauses.push_back({static_cast<int>(literals.size()), static_cast<int>(clauseLiterals.size()), learnt, false, 0});
+    literals.insert(literals.end(), clauseLiterals.begin(), clauseLiterals.end());
+    watches[clauseLiterals[0]].push_back({clauseIndex, clauseLiterals[1]});
+    watches[clauseLiterals[1]].push_back({clauseIndex, clauseLiterals[0]});
+    return clauseIndex;
+}
+
+void SatSolver::assign(Literal literal, int reason)
+{
+    const int variable = variableOf(literal);
+    assignments[variable] = (literal & 1) ? False : True;
+    levels[variable] = decisionLevel();
+    reasons[variable] = reason;
+    trail.push_back(literal);
+}
+
+int SatSolver::propagate()
+{
+    int conflict = -1;
+    while (propagationHead < trail.size())
+    {
+        // The literal that became true makes its negation false, every clause watching the negation needs a new watch or has become unit
+        const Literal falseLiteral = negation(trail[propagationHead++]);
+        vector<Watcher>& watchList = watches[falseLiteral];
+        solverStats.propagations++;
+        
+        size_t kept = 0;
+        size_t next = 0;
+        while (next < watchList.size())
+        {
+            const Watcher watcher = watchList[next++];
+            if (valueOf(watcher.blocker) == True)
+            {
+                watchList[kept++] = watcher;
+                continue;
+            }
+            
+            const Clause& clause = clauses[watcher.clause];
+            Literal* clauseLiterals = &literals[clause.start];
+            if (clauseLiterals[0] == falseLiteral) { swap(clauseLiterals[0], clauseLiterals[1]); }
+            
+            const Literal other = clauseLiterals[0];
+            if (other != watcher.blocker && valueOf(other) == True)
+            {
+                watchList[kept++] = {watcher.clause, other};
+                continue;
+            }
+            
+            bool moved = false;
+            for (int i = 2; i < clause.size; i++)
+            {
+                if (valueOf(clauseLiterals[i]) != False)
+                {
+                    swap(clauseLiterals[1], clauseLiterals[i]);
+                    watches[clauseLiterals[1]].push_back({watcher.clause, other});
+                    moved = true;
+                    break;
+                }
+            }
+            if (moved) { continue; }
+            
+            watchList[kept++] = {watcher.clause, other};
+            if (valueOf(other) == False)
+            {
+                // Keep the rest of the watchers and stop, the caller deals with the conflict
+                conflict = watcher.clause;
+                propagationHead = trail.size();
+                while (next < watchList.size()) { watchList[kept++] = watchList[next++]; }
+            }
+            else
+            {
+                assign(other, watcher.clause);
+            }
+        }
+        watchList.resize(kept);
+        if (conflict != -1) { break; }
+    }
+    return conflict;
+}
+
+int SatSolver::analyse(int conflict)
+{
+    learnt.clear();
+    learnt.push_back(0);
+    analyseClear.clear();
+    
+    // Walk back along the trail resolving away every literal of the current level until only one is left, the first unique implication point
+    int pathCount = 0;
+    Literal implied = -1;
+    int trailIndex = static_cast<int>(trail.size()) - 1;
+    int clauseIndex = conflict;
+    do
+    {
+        Clause& clause = clauses[clauseIndex];
+        if (clause.learnt) { bumpClause(clause); }
+        
+        // The first literal of a reason clause is the literal it implied, which is the one being resolved on
+        for (int i = implied == -1 ? 0 : 1; i < clause.size; i++)
+        {
+            const Literal literal = literals[clause.start + i];
+            const int variable = variableOf(literal);
+            if (seen[variable] || levels[variable] == 0) { continue; }
+            
+            seen[variable] = 1;
+            bumpVariable(variable);
+            if (levels[variable] >= decisionLevel())
+            {
+                pathCount++;
+            }
+            else
+            {
+                learnt.push_back(literal);
+            }
+        }
+        
+        while (!seen[variableOf(trail[trailIndex])]) { trailIndex--; }
+        implied = trail[trailIndex--];
+        clauseIndex = reasons[variableOf(implied)];
+        seen[variableOf(implied)] = 0;
+        pathCount--;
+    } while (pathCount > 0);
+    learnt[0] = negation(implied);
+    
+    analyseClear.assign(learnt.begin() + 1, learnt.end());
+    minimiseLearnt();
+    for (const Literal literal : analyseClear) { seen[variableOf(literal)] = 0; }
+    
+    // Watch the literal from the highest remaining level second so the clause becomes unit right after the backjump
+    int backtrackLevel = 0;
+    for (size_t i = 1; i < learnt.size(); i++)
+    {
+        if (levels[variableOf(learnt[i])] > backtrackLevel)
+        {
+            backtrackLevel = levels[variableOf(learnt[i])];
+            swap(learnt[1], learnt[i]);
+        }
+    }
+    return backtrackLevel;
+}
+
+void SatSolver::minimiseLearnt()
+{
+    // A literal whose reason is made only of literals that are already in the clause, or fixed at level 0, is implied by the rest of the clause
+    size_t kept = 1;
+    for (size_t i = 1; i < learnt.size(); i++)
+    {
+        const int reason = reasons[variableOf(learnt[i])];
+        bool redundant = reason != -1;
+        if (redundant)
+        {
+            const Clause& clause = clauses[reason];
+            for (int j = 1; j < clause.size; j++)
+            {
+                const int variable = variableOf(literals[clause.start + j]);
+                if (!seen[variable] && levels[variable] > 0)
+                {
+                    redundant = false;
+                    break;
+                }
+            }
+        }
+        if (!redundant) { learnt[kept++] = learnt[i]; }
+    }
+    learnt.resize(kept);
+}
+
+void SatSolver::backtrack(int level)
+{
+    if (decisionLevel() <= level) { return; }
+    
+    for (int i = static_cast<int>(trail.size()) - 1; i >= trailLimits[level]; i--)
+    {
+        const int variable = variableOf(trail[i]);
+        polarities[variable] = assignments[variable] == True;
+        assignments[variable] = Undefined;
+        reasons[variable] = -1;
+        if (heapPositions[variable] == -1) { heapInsert(variable); }
+    }
+    trail.resize(trailLimits[level]);
+    trailLimits.resize(level);
+    propagationHead = trail.size();
+}
+
+void SatSolver::bumpVariable(int variable)
+{
+    activity[variable] += variableIncrement;
+    if (activity[variable] > activityLimit)
+    {
+        for (auto& value : activity) { value /= activityLimit; }
+        variableIncrement /= activityLimit;
+    }
+    if (heapPositions[variable] != -1) { heapUp(heapPositions[variable]); }
+}
+
+void SatSolver::bumpClause(Clause& clause)
+{
+    clause.activity += clauseIncrement;
+    if (clause.activity > activityLimit)
+    {
+        for (auto& other : clauses)
+        {
+            if (other.learnt) { other.activity /= activityLimit; }
+        }
+        clauseIncrement /= activityLimit;
+    }
+}
+
+void SatSolver::reduceLearnt()
+{
+    // Binary clauses are cheap to keep and tend to be the useful ones
+    reduceOrder.clear();
+    for (int i = 0; i < static_cast<int>(clauses.size()); i++)
+    {
+        if (clauses[i].learnt && clauses[i].size > 2) { reduceOrder.push_back(i); }
+    }
+    sort(reduceOrder.begin(), reduceOrder.end(), [this](int first, int second) { return clauses[first].activity < clauses[second].activity; });
+    for (size_t i = 0; i < reduceOrder.size() / 2; i++)
+    {
+        clauses[reduceOrder[i]].deleted = true;
+        learntCount--;
+    }
+    
+    // Pack the surviving clauses down and watch them again, literal order is kept so the first two are still the watched ones.
+    // At level 0 nothing is ever resolved on so the reasons of the level 0 assignments can be dropped rather than renumbered.
+    for (const Literal literal : trail) { reasons[variableOf(literal)] = -1; }
+    for (auto& watchList : watches) { watchList.clear(); }
+    int packedLiterals = 0;
+    int packedClauses = 0;
+    for (size_t i = 0; i < clauses.size(); i++)
+    {
+        Clause clause = clauses[i];
+        if (clause.deleted) { continue; }
+        
+        copy(literals.begin() + clause.start, literals.begin() + clause.start + clause.size, literals.begin() + packedLiterals);
+        clause.start = packedLiterals;
+        packedLiterals += clause.size;
+        clauses[packedClauses] = clause;
+        watches[literals[clause.start]].push_back({packedClauses, literals[clause.start + 1]});
+        watches[literals[clause.start + 1]].push_back({packedClauses, literals[clause.start]});
+        packedClauses++;
+    }
+    literals.resize(packedLiterals);
+    clauses.resize(packedClauses);
+}
+
+SatSolver::Result SatSolver::solve(long conflictLimit)
+{
+    if (unsatisfiable) { return Result::Unsatisfiable; }
+    if (propagate() != -1)
+    {
+        unsatisfiable = true;
+        return Result::Unsatisfiable;
+    }
+    
+    if (maxLearnts == 0) { maxLearnts = max(2000.0, problemClauses / 3.0); }
+    long conflicts = 0;
+    long restartIndex = 0;
+    long restartConflicts = luby(restartIndex) * restartUnit;
+    
+    while (true)
+    {
+        const int conflict = propagate();
+        if (conflict != -1)
+        {
+            solverStats.conflicts++;
+            conflicts++;
+            restartConflicts--;
+            if (decisionLevel() == 0)
+            {
+                unsatisfiable = true;
+                return Result::Unsatisfiable;
+            }
+            
+            const int backtrackLevel = analyse(conflict);
+            backtrack(backtrackLevel);
+            if (learnt.size() == 1)
+            {
+                assign(learnt[0], -1);
+            }
+            else
+            {
+                const int clauseIndex = attachClause(learnt, true);
+                bumpClause(clauses[clauseIndex]);
+                assign(learnt[0], clauseIndex);
+                learntCount++;
+                solverStats.learntClauses++;
+            }
+            variableIncrement /= variableDecay;
+            clauseIncrement /= clauseDecay;
+            continue;
+        }
+        
+        if (conflictLimit >= 0 && conflicts >= conflictLimit)
+        {
+            backtrack(0);
+            return Result::Unknown;
+        }
+        if (restartConflicts <= 0)
+        {
+            backtrack(0);
+            solverStats.restarts++;
+            restartConflicts = luby(++restartIndex) * restartUnit;
+            if (learntCount > maxLearnts)
+            {
+                reduceLearnt();
+                maxLearnts *= 1.1;
+            }
+            continue;
+        }
+        
+        int decision = -1;
+        while (!heap.empty())
+        {
+            const int variable = heapRemoveMax();
+            if (assignments[variable] == Undefined)
+            {
+                decision = variable;
+                break;
+            }
+        }
+        if (decision == -1)
+        {
+            for (int variable = 0; variable < variableCount(); variable++) { model[variable] = assignments[variable] == True; }
+            backtrack(0);
+            return Result::Satisfiable;
+        }
+        
+        solverStats.decisions++;
+        trailLimits.push_back(static_cast<int>(trail.size()));
+        assign(literal(decision, polarities[decision] != 0), -1);
+    }
+}
+
+void SatSolver::heapInsert(int variable)
+{
+    heapPositions[variable] = static_cast<int>(heap.size());
+    heap.push_back(variable);
+    heapUp(heapPositions[variable]);
+}
+
+int SatSolver::heapRemoveMax()
+{
+    const int top = heap[0];
+    heap[0] = heap.back();
+    heapPositions[heap[0]] = 0;
+    heap.pop_back();
+    heapPositions[top] = -1;
+    if (!heap.empty()) { heapDown(0); }
+    return top;
+}
+
+void SatSolver::heapUp(int position)
+{
+    const int variable = heap[position];
+    while (position > 0)
+    {
+        const int parent = (position - 1) / 2;
+        if (activity[heap[parent]] >= activity[variable]) { break; }
+        heap[position] = heap[parent];
+        heapPositions[heap[position]] = position;
+        position = parent;
+    }
+    heap[position] = variable;
+    heapPositions[variable] = position;
+}
+
+void SatSolver::heapDown(int position)
+{
+    const int variable = heap[position];
+    const int size = static_cast<int>(heap.size());
+    while (true)
+    {
+        int child = 2 * position + 1;
+        if (child >= size) { break; }
+        if (child + 1 < size && heapLess(child, child + 1)) { child++; }
+        if (activity[heap[child]] <= activity[variable]) { break; }
+        heap[position] = heap[child];
+        heapPositions[heap[position]] = position;
+        position = child;
+    }
+    heap[position] = variable;
+    heapPositions[variable] = position;
+}
+
+long SatSolver::luby(long index)
+{
+    // 1, 1, 2, 1, 1, 2, 4, 1, 1, 2, ... find the complete subsequence index falls in and recurse into it
+    long size = 1;
+    int sequence = 0;
+    while (size < index + 1)
+    {
+        sequence++;
+        size = 2 * size + 1;
+    }
+    while (size - 1 != index)
+    {
+        size = (size - 1) / 2;
+        sequence--;
+        index = index % size;
+    }
+    return 1L << sequence;
+}
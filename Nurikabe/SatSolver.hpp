@@ -0,0 +1,164 @@
+//
+//  SatSolver.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef SatSolver_hpp
+#define SatSolver_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// A small conflict driven clause learning SAT solver: two watched literals, VSIDS branching with phase saving, first UIP learning with clause minimisation,
+/// Luby restarts and halving the learnt clauses at a restart once there are too many of them.
+///
+/// - Discussion: Clauses can be added between calls to solve, the learnt clauses are kept, so a problem can be refined one constraint at a time the way SatBackend adds its connectivity cuts.
+/// Every clause lives in one flat array of literals and the storage is reused after clear so a solver that is reused for many problems stops allocating.
+class SatSolver
+{
+public:
+    /// 2 * variable for the variable being true and 2 * variable + 1 for it being false
+    typedef int Literal;
+    
+    static Literal literal(int variable, bool value) { return 2 * variable + (value ? 0 : 1); };
+    static Literal negation(Literal literal) { return literal ^ 1; };
+    static int variableOf(Literal literal) { return literal >> 1; };
+    
+    enum class Result
+    {
+        Satisfiable,
+        Unsatisfiable,
+        Unknown         // The conflict limit was reached first
+    };
+    
+    /// Counters since the last clear
+    struct Stats
+    {
+        long decisions = 0;
+        long propagations = 0;
+        long conflicts = 0;
+        long learntClauses = 0;
+        long restarts = 0;
+    };
+    
+    /// Forgets every variable and clause
+    void clear();
+    
+    /// - Returns: The new variable, variables are numbered from 0
+    int addVariable();
+    int variableCount() const { return static_cast<int>(assignments.size()); };
+    
+    /// Adds a clause, duplicate literals are fine. It can be called before the first solve or between solves.
+    ///
+    /// - Returns: false if the clauses can no longer be satisfied
+    bool addClause(const std::vector<Literal>& literals);
+    
+    /// The number of clauses added with addClause that weren't already satisfied, unit clauses are assigned straight away and aren't counted
+    long problemClauseCount() const { return problemClauses; };
+    
+    /// - Parameters:
+    ///     - conflictLimit: The most conflicts to run into before giving up with Unknown, a negative limit never gives up
+    Result solve(long conflictLimit = -1);
+    
+    /// The value the variable had in the model found by the last solve that returned Satisfiable
+    bool modelValue(int variable) const { return model[variable] != 0; };
+    
+    const Stats& stats() const { return solverStats; };
+
+private:
+    enum Value : uint8_t { False = 0, True = 1, Undefined = 2 };
+    
+    struct Clause
+    {
+        /// The clause's literals are literals[start] up to literals[start + size], the first two are the watched ones.
+        /// When the clause is the reason for an assignment the assigned literal is the first one.
+        int start;
+        int size;
+        bool learnt;
+        bool deleted;
+        double activity;
+    };
+    
+    struct Watcher
+    {
+        int clause;
+        /// A literal of the clause, if it is true the clause doesn't have to be looked at
+        Literal blocker;
+    };
+    
+    Value valueOf(Literal literal) const
+    {
+        const Value value = assignments[variableOf(literal)];
+        return value == Undefined ? Undefined : static_cast<Value>(value ^ (literal & 1));
+    };
+    int decisionLevel() const { return static_cast<int>(trailLimits.size()); };
+    
+    /// Adds a clause of at least two literals and watches its first two
+    int attachClause(const std::vector<Literal>& clauseLiterals, bool learnt);
+    void assign(Literal literal, int reason);
+    /// - Returns: The index of a clause whose literals are all false or -1
+    int propagate();
+    /// Works out the first UIP clause of the conflict into learnt and the level to go back to
+    int analyse(int conflict);
+    /// Takes literals out of learnt whose reasons are made of literals that are already in it
+    void minimiseLearnt();
+    void backtrack(int level);
+    
+    void bumpVariable(int variable);
+    void bumpClause(Clause& clause);
+    /// Deletes the less active half of the learnt clauses, only called at level 0 so no clause is the reason for anything that matters
+    void reduceLearnt();
+    
+    // A binary max heap of the unassigned variables by activity
+    void heapInsert(int variable);
+    int heapRemoveMax();
+    void heapUp(int position);
+    void heapDown(int position);
+    bool heapLess(int first, int second) const { return activity[heap[first]] < activity[heap[second]]; };
+    
+    static long luby(long index);
+    
+    std::vector<Literal> literals = std::vector<Literal>();
+    std::vector<Clause> clauses = std::vector<Clause>();
+    /// The clauses that watch each literal, indexed by literal
+    std::vector<std::vector<Watcher>> watches = std::vector<std::vector<Watcher>>();
+    long problemClauses = 0;
+    long learntCount = 0;
+    double maxLearnts = 0;
+    bool unsatisfiable = false;
+    
+    // Per variable state
+    std::vector<Value> assignments = std::vector<Value>();
+    std::vector<int> levels = std::vector<int>();
+    /// The clause that implied each assignment or -1 for a decision
+    std::vector<int> reasons = std::vector<int>();
+    /// The value each variable had when it was last unassigned, used as the value to try first
+    std::vector<uint8_t> polarities = std::vector<uint8_t>();
+    std::vector<double> activity = std::vector<double>();
+    std::vector<uint8_t> seen = std::vector<uint8_t>();
+    std::vector<uint8_t> model = std::vector<uint8_t>();
+    double variableIncrement = 1;
+    double clauseIncrement = 1;
+    
+    /// Variables in heap order and the position of each variable in the heap or -1
+    std::vector<int> heap = std::vector<int>();
+    std::vector<int> heapPositions = std::vector<int>();
+    
+    /// Every assigned literal in the order it was assigned, trailLimits holds where each decision level starts
+    std::vector<Literal> trail = std::vector<Literal>();
+    std::vector<int> trailLimits = std::vector<int>();
+    size_t propagationHead = 0;
+    
+    // Scratch space for analyse and addClause
+    std::vector<Literal> learnt = std::vector<Literal>();
+    std::vector<Literal> analyseClear = std::vector<Literal>();
+    std::vector<Literal> addScratch = std::vector<Literal>();
+    std::vector<int> reduceOrder = std::vector<int>();
+    
+    Stats solverStats = Stats();
+};
+
+#endif /* SatSolver_hpp */
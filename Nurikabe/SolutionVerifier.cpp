@@ -0,0 +1,148 @@
+//
+//  SolutionVerifier.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "SolutionVerifier.hpp"
+#include "Grid.hpp"
+#include "GridSnapshot.hpp"
+
+using namespace std;
+
+SolutionVerifier::Failure SolutionVerifier::verify(const Grid& grid)
+{
+    width = grid.width;
+    height = grid.height;
+    const int cellCount = width * height;
+    colours.resize(cellCount);
+    for (int i = 0; i < cellCount; i++)
+    {
+        switch (grid.cellTypes[i]) {
+            case Grid::Cell::Type::Unknown:
+                colours[i] = Unknown;
+                break;
+            case Grid::Cell::Type::Black:
+                colours[i] = Black;
+                break;
+            case Grid::Cell::Type::White:
+            case Grid::Cell::Type::Numbered:
+                colours[i] = White;
+                break;
+        }
+    }
+    // Unnumbered cells are already -1 in the grid
+    numbers.assign(grid.cellNumbers.begin(), grid.cellNumbers.end());
+    return verifyCells();
+}
+
+SolutionVerifier::Failure SolutionVerifier::verify(const GridSnapshot& snapshot)
+{
+    width = snapshot.width;
+    height = snapshot.height;
+    const int cellCount = width * height;
+    colours.resize(cellCount);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            colours[y * width + x] = static_cast<uint8_t>(snapshot.cell(x, y));
+        }
+    }
+    numbers.assign(cellCount, -1);
+    for (const auto& clue : snapshot.clues)
+    {
+        numbers[clue.index] = clue.number;
+    }
+    return verifyCells();
+}
+
+SolutionVerifier::Failure SolutionVerifier::fail(Failure failure, int cellIndex)
+{
+    failedCellIndex = cellIndex;
+    return failure;
+}
+
+SolutionVerifier::Failure SolutionVerifier::verifyCells()
+{
+    failedCellIndex = -1;
+    const int cellCount = width * height;
+    visited.assign(cellCount, 0);
+    
+    bool foundBlackRegion = false;
+    for (int cellIndex = 0; cellIndex < cellCount; cellIndex++)
+    {
+        const uint8_t colour = colours[cellIndex];
+        if (colour == Unknown) { return fail(Failure::Incomplete, cellIndex); }
+        if (colour == Black)
+        {
+            if (numbers[cellIndex] != -1) { return fail(Failure::BlackNumber, cellIndex); }
+            
+            // The window this cell is the top left corner of
+            if (cellIndex + width + 1 < cellCount && colours[cellIndex + 1] == Black && colours[cellIndex + width] == Black && colours[cellIndex + width + 1] == Black &&
+                cellIndex % width + 1 < width)
+            {
+                return fail(Failure::BlackPool, cellIndex);
+            }
+        }
+        
+        if (visited[cellIndex]) { continue; }
+        
+        // All of the black cells have to be reached by the flood fill from the first one
+        if (colour == Black && foundBlackRegion) { return fail(Failure::DisconnectedBlack, cellIndex); }
+        foundBlackRegion = foundBlackRegion || colour == Black;
+        
+        int size = 0;
+        int number = -1;
+        int numberIndex = -1;
+        visited[cellIndex] = 1;
+        stack.clear();
+        stack.push_back(cellIndex);
+        while (!stack.empty())
+        {
+            const int index = stack.back();
+            stack.pop_back();
+            size++;
+            
+            if (numbers[index] != -1)
+            {
+                if (number != -1) { return fail(Failure::IslandWithManyNumbers, index); }
+                number = numbers[index];
+                numberIndex = index;
+            }
+            
+            const int indexX = index % width;
+            const int adjacentIndices[] = { index + width, index - width, index - 1, index + 1 };
+            const bool inBounds[] = { index + width < cellCount, index >= width, indexX > 0, indexX + 1 < width };
+            for (int i = 0; i < 4; i++)
+            {
+                if (!inBounds[i]) { continue; }
+                const int adjacentIndex = adjacentIndices[i];
+                if (visited[adjacentIndex] || colours[adjacentIndex] != colour) { continue; }
+                visited[adjacentIndex] = 1;
+                stack.push_back(adjacentIndex);
+            }
+        }
+        
+        if (colour == Black) { continue; }
+        if (number == -1) { return fail(Failure::IslandWithoutNumber, cellIndex); }
+        if (size != number) { return fail(Failure::WrongIslandSize, numberIndex); }
+    }
+    return Failure::None;
+}
+
+const char* SolutionVerifier::failureName(Failure failure)
+{
+    switch (failure) {
+        case Failure::None: return "none";
+        case Failure::Incomplete: return "incomplete";
+        case Failure::BlackNumber: return "black number";
+        case Failure::IslandWithoutNumber: return "island without a number";
+        case Failure::IslandWithManyNumbers: return "island with more than one number";
+        case Failure::WrongIslandSize: return "island of the wrong size";
+        case Failure::DisconnectedBlack: return "disconnected black cells";
+        case Failure::BlackPool: return "2x2 black pool";
+    }
+    return "";
+}
@@ -0,0 +1,70 @@
+//
+//  SolutionVerifier.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef SolutionVerifier_hpp
+#define SolutionVerifier_hpp
+
+#include <cstdint>
+#include <vector>
+
+class Grid;
+class GridSnapshot;
+
+/// Checks a finished grid against every rule of Nurikabe without solving anything.
+///
+/// - Discussion: The colours and numbers are copied into flat arrays and every cell is visited once, islands and the black wall are measured with a flood fill as their first cell is reached
+/// and the 2x2 pools are checked in the same pass. The scratch arrays are kept between calls so a verifier that is reused doesn't allocate, which makes it cheap enough to check every leaf of a search.
+class SolutionVerifier
+{
+public:
+    enum class Failure
+    {
+        None,
+        /// A cell is still unknown
+        Incomplete,
+        /// A numbered cell is black
+        BlackNumber,
+        /// An island has no numbered cell
+        IslandWithoutNumber,
+        /// An island has more than one numbered cell
+        IslandWithManyNumbers,
+        /// An island is not the size of its number
+        WrongIslandSize,
+        /// The black cells are split into more than one region
+        DisconnectedBlack,
+        /// A 2x2 window is all black
+        BlackPool
+    };
+    
+    /// - Returns: Failure::None if the grid is a valid solution, otherwise the first rule that was found to be broken. failedCellIndex is set to a cell where it was broken.
+    Failure verify(const Grid& grid);
+    Failure verify(const GridSnapshot& snapshot);
+    
+    static const char* failureName(Failure);
+    
+    /// The flat index of a cell involved in the last failure or -1
+    int failedCellIndex = -1;
+
+private:
+    enum Colour : uint8_t { Unknown = 0, White = 1, Black = 2 };
+    
+    /// Runs the checks on the colours and numbers arrays
+    Failure verifyCells();
+    Failure fail(Failure failure, int cellIndex);
+    
+    int width = 0;
+    int height = 0;
+    /// One Colour per cell in row order
+    std::vector<uint8_t> colours = std::vector<uint8_t>();
+    /// The number of every numbered cell, -1 for every other cell
+    std::vector<int> numbers = std::vector<int>();
+    /// 1 once the flood fill has reached a cell, bytes rather than bits because it is read for every neighbour
+    std::vector<uint8_t> visited = std::vector<uint8_t>();
+    std::vector<int> stack = std::vector<int>();
+};
+
+#endif /* SolutionVerifier_hpp */
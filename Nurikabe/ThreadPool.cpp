@@ -0,0 +1,122 @@
+//
+//  ThreadPool.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "ThreadPool.hpp"
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned threadCount):
+nextWorker(0),
+queuedTasks(0),
+unfinishedTasks(0),
+sleepingWorkers(0)
+{
+    if (threadCount == 0) { threadCount = max(1u, thread::hardware_concurrency()); }
+    
+    for (unsigned i = 0; i < threadCount; i++)
+    {
+        workers.push_back(unique_ptr<Worker>(new Worker()));
+    }
+    for (unsigned i = 0; i < threadCount; i++)
+    {
+        threads.push_back(thread(&ThreadPool::run, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& workerThread : threads)
+    {
+        workerThread.join();
+    }
+}
+
+void ThreadPool::submit(Task task)
+{
+    // Counted as unfinished before it can be taken so that wait() can't see 0 while it runs
+    unfinishedTasks++;
+    const unsigned workerIndex = nextWorker.fetch_add(1, memory_order_relaxed) % workers.size();
+    {
+        lock_guard<mutex> lock(workers[workerIndex]->mutex);
+        workers[workerIndex]->tasks.push_back(move(task));
+    }
+    queuedTasks++;
+    
+    // A worker counts itself as sleeping before it checks queuedTasks and this checks sleepingWorkers after counting the task, so either the worker sees the task or this sees the worker.
+    // Taking the mutex then means the worker is either still before its check or already waiting, it can't miss the notify in between.
+    if (sleepingWorkers.load() > 0)
+    {
+        { lock_guard<mutex> lock(stateMutex); }
+        wake.notify_one();
+    }
+}
+
+void ThreadPool::wait()
+{
+    unique_lock<mutex> lock(stateMutex);
+    idle.wait(lock, [this] { return unfinishedTasks.load() == 0; });
+}
+
+bool ThreadPool::takeTask(unsigned workerIndex, Task& task)
+{
+    // Our own queue is taken from the front so tasks run roughly in the order they were submitted, steal from the back to stay out of the owner's way
+    for (size_t offset = 0; offset < workers.size(); offset++)
+    {
+        auto& worker = *workers[(workerIndex + offset) % workers.size()];
+        lock_guard<mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) { continue; }
+        
+        if (offset == 0)
+        {
+            task = move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+        else
+        {
+            task = move(worker.tasks.back());
+            worker.tasks.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(unsigned workerIndex)
+{
+    Task task;
+    while (true)
+    {
+        if (takeTask(workerIndex, task))
+        {
+            queuedTasks--;
+            task(workerIndex);
+            task = nullptr;
+            
+            // Only the last task to finish takes the mutex, for the same reason submit does
+            if (--unfinishedTasks == 0)
+            {
+                { lock_guard<mutex> lock(stateMutex); }
+                idle.notify_all();
+            }
+            continue;
+        }
+        
+        // A task can still be counted after another worker has taken it, or be missed because it was stolen while this worker looked through the queues,
+        // so a worker only sleeps once nothing is counted and otherwise looks again
+        unique_lock<mutex> lock(stateMutex);
+        sleepingWorkers++;
+        wake.wait(lock, [this] { return queuedTasks.load() > 0 || stopping; });
+        sleepingWorkers--;
+        if (stopping && queuedTasks.load() == 0) { return; }
+    }
+}
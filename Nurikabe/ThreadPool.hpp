@@ -0,0 +1,75 @@
+//
+//  ThreadPool.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A fixed set of worker threads that each own a queue of tasks. Tasks are handed to the workers round robin and a worker that runs out of tasks steals from the back of another worker's queue,
+/// so one slow task doesn't hold up the tasks queued behind it.
+class ThreadPool
+{
+public:
+    /// A task is told the index of the worker that runs it so it can use state that belongs to that worker without locking
+    typedef std::function<void(unsigned workerIndex)> Task;
+    
+    /// - Parameters:
+    ///     - threadCount: The number of worker threads, 0 uses one per hardware thread
+    explicit ThreadPool(unsigned threadCount = 0);
+    
+    /// Waits for every task that was submitted to finish before joining the workers
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    void submit(Task task);
+    
+    /// Blocks until every task that has been submitted has finished
+    void wait();
+    
+    unsigned threadCount() const { return static_cast<unsigned>(threads.size()); };
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    
+    /// Takes the next task from the worker's own queue or failing that steals one from another worker
+    bool takeTask(unsigned workerIndex, Task& task);
+    void run(unsigned workerIndex);
+    
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<unsigned> nextWorker;
+    
+    /// Tasks that are sitting in a queue, a task is counted after it is pushed and uncounted after it is taken
+    std::atomic<size_t> queuedTasks;
+    /// Tasks that have been submitted but have not finished
+    std::atomic<size_t> unfinishedTasks;
+    /// Workers that are asleep or about to go to sleep on wake, submit only takes the state mutex to wake one when there are any
+    std::atomic<unsigned> sleepingWorkers;
+    
+    // Only taken to go to sleep and to wake a sleeper, workers sleep on wake when there is nothing to take and wait() sleeps on idle
+    std::mutex stateMutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    /// Guarded by the state mutex
+    bool stopping = false;
+};
+
+#endif /* ThreadPool_hpp */
@@ -0,0 +1,48 @@
+//
+//  TranspositionTable.cpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#include "TranspositionTable.hpp"
+
+using namespace std;
+
+constexpr int TranspositionTable::maxSolutions;
+constexpr uint64_t TranspositionTable::valueMask;
+constexpr uint64_t TranspositionTable::outcomeMask;
+constexpr uint64_t TranspositionTable::exactBit;
+constexpr int TranspositionTable::solutionsShift;
+constexpr uint64_t TranspositionTable::solutionsMask;
+
+TranspositionTable::TranspositionTable(size_t bytes)
+{
+    size_t capacity = 1;
+    while (capacity * 2 * sizeof(uint64_t) <= bytes)
+    {
+        capacity *= 2;
+    }
+    entries.reset(new atomic<uint64_t>[capacity]);
+    mask = capacity - 1;
+    clear();
+}
+
+void TranspositionTable::clear()
+{
+    // An empty entry has an outcome of Unknown so it never matches a lookup
+    for (size_t i = 0; i < capacity(); i++)
+    {
+        entries[i].store(0, memory_order_relaxed);
+    }
+}
+
+size_t TranspositionTable::occupiedEntries() const
+{
+    size_t count = 0;
+    for (size_t i = 0; i < capacity(); i++)
+    {
+        if ((entries[i].load(memory_order_relaxed) & outcomeMask) != 0) { count++; }
+    }
+    return count;
+}
@@ -0,0 +1,102 @@
+//
+//  TranspositionTable.hpp
+//  Nurikabe
+//
+//  Copyright © 2018 Benjamin Luke. All rights reserved.
+//
+
+#ifndef TranspositionTable_hpp
+#define TranspositionTable_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/// A fixed size table of what is known about the search states a grid has been through, keyed by Grid::stateHash.
+///
+/// - Discussion: Every entry is a single 64 bit word holding the top 56 bits of the hash, a 2 bit outcome and for ManySolutions how many solutions were found, so entries are read and written with plain atomic loads and stores
+/// and any number of grids on any number of threads can share a table without locking. Each hash has exactly one slot and a store always replaces what was there,
+/// a lookup that finds a different hash in the slot is a miss. The hash includes the puzzle so one table can be shared by grids solving different puzzles.
+class TranspositionTable
+{
+public:
+    /// What a completed search below a state found
+    enum class Outcome : uint8_t
+    {
+        Unknown = 0,
+        /// No solution
+        Dead = 1,
+        OneSolution = 2,
+        /// At least two solutions, see Entry for how many
+        ManySolutions = 3
+    };
+    
+    /// Everything an entry holds
+    struct Entry
+    {
+        Outcome outcome;
+        /// For ManySolutions the number of solutions the search found, between 2 and maxSolutions
+        int solutions;
+        /// For ManySolutions true when the search finished so there are exactly solutions solutions, otherwise it stopped early and there are at least that many
+        bool exact;
+    };
+    
+    /// The most solutions an entry can count, a search that found more is stored as having found at least this many
+    static constexpr int maxSolutions = 31;
+    
+    /// - Parameters:
+    ///     - bytes: The most memory the entries may use, rounded down to a power of two number of entries and at least one entry
+    explicit TranspositionTable(size_t bytes);
+    
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+    
+    Outcome lookup(uint64_t hash) const { return lookupEntry(hash).outcome; };
+    
+    Entry lookupEntry(uint64_t hash) const
+    {
+        const uint64_t entry = entries[hash & mask].load(std::memory_order_relaxed);
+        if ((entry & ~valueMask) != (hash & ~valueMask)) { return Entry { Outcome::Unknown, 0, false }; }
+        return Entry { static_cast<Outcome>(entry & outcomeMask), static_cast<int>(entry >> solutionsShift & solutionsMask), (entry & exactBit) != 0 };
+    };
+    
+    /// Stores Dead or OneSolution, ManySolutions is stored with storeSolutions
+    void store(uint64_t hash, Outcome outcome) { storeValue(hash, static_cast<uint64_t>(outcome)); };
+    
+    /// Stores ManySolutions with the number of solutions a search found, at least 2
+    ///
+    /// - Parameters:
+    ///     - exact: True if the search finished, ignored when there are more than maxSolutions
+    void storeSolutions(uint64_t hash, int solutions, bool exact)
+    {
+        exact = exact && solutions <= maxSolutions;
+        const uint64_t count = static_cast<uint64_t>(std::min(solutions, maxSolutions));
+        storeValue(hash, static_cast<uint64_t>(Outcome::ManySolutions) | (exact ? exactBit : 0) | count << solutionsShift);
+    };
+    
+    /// Forgets every entry, it is not safe to call while other threads use the table
+    void clear();
+    
+    size_t capacity() const { return mask + 1; };
+    size_t memoryBytes() const { return capacity() * sizeof(uint64_t); };
+    
+    /// - Returns: The number of entries that hold an outcome, found by scanning the whole table
+    size_t occupiedEntries() const;
+
+private:
+    // The low byte of an entry: the outcome in bits 0 and 1, the exact flag in bit 2 and the number of solutions in bits 3 to 7
+    static constexpr uint64_t valueMask = 0xff;
+    static constexpr uint64_t outcomeMask = 3;
+    static constexpr uint64_t exactBit = 4;
+    static constexpr int solutionsShift = 3;
+    static constexpr uint64_t solutionsMask = 31;
+    
+    void storeValue(uint64_t hash, uint64_t value) { entries[hash & mask].store((hash & ~valueMask) | value, std::memory_order_relaxed); };
+    
+    std::unique_ptr<std::atomic<uint64_t>[]> entries;
+    size_t mask;
+};
+
+#endif /* TranspositionTable_hpp */
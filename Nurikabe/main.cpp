@@ -8,9 +8,14 @@
 
 #include <iostream>
 #include "Grid.hpp"
-#include <CoreServices/CoreServices.h>
+#include "Benchmark.hpp"
+#include "BatchSolver.hpp"
+#include "Corpus.hpp"
+#include "ParallelSearch.hpp"
+#include <cstdlib>
 #include <chrono>
 #include <sstream>
+#include <string>
 
 using namespace std;
 using namespace std::chrono;
@@ -33,9 +38,9 @@ struct GridMetadata
 {
     GridMetadata(const string& aGridString, int aWidth, int aHeight, const string& aName):
     gridString(aGridString),
+    name(aName),
     width(aWidth),
-    height(aHeight),
-    name(aName) { }
+    height(aHeight) { }
     
     string gridString;
     string name;
@@ -44,6 +49,45 @@ struct GridMetadata
 };
 
 int main(int argc, const char * argv[]) {
+    
+    if (argc > 1 && string(argv[1]) == "--bench")
+    {
+        return runBenchmark(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--batch")
+    {
+        return runBatch(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--convert")
+    {
+        if (argc != 4)
+        {
+            cerr << "Usage: Nurikabe --convert <corpus file> <binary corpus file>" << endl;
+            return 2;
+        }
+        
+        CorpusReader reader(argv[2]);
+        string error;
+        if (!writeBinaryCorpus(argv[3], reader, error))
+        {
+            cerr << error << endl;
+            return 1;
+        }
+        return 0;
+    }
+    
+    // Without a mode the example grids are solved, --threads searches each of them on that many threads
+    unsigned threadCount = 1;
+    if (argc == 3 && string(argv[1]) == "--threads")
+    {
+        threadCount = static_cast<unsigned>(max(0, atoi(argv[2])));
+    }
+    else if (argc > 1)
+    {
+        cerr << "Usage: Nurikabe [--threads <n>] | --bench ... | --batch ... | --convert ..." << endl;
+        return 2;
+    }
+    ParallelSearch parallelSearch(threadCount);
 
     std::string easyWikipediaGrid =
     "1   4  4 2"
@@ -80,12 +124,18 @@ int main(int argc, const char * argv[]) {
         
         const auto start = chrono::steady_clock::now();
         
-        grid.solve();
+        const bool solved = parallelSearch.threadCount() == 1 ? grid.solveWithSearch() : parallelSearch.solve(grid);
         
         const auto finish = chrono::steady_clock::now();
+        const auto& stats = parallelSearch.threadCount() == 1 ? grid.searchStats() : parallelSearch.searchStats();
+        const auto& ruleStats = parallelSearch.threadCount() == 1 ? grid.solveStats() : parallelSearch.solveStats();
         
-        cout << "Finished Grid " << gridMetdata.name << endl;
-        cout << "Total execution time: " << formatTime(start, finish) << endl << endl;;
+        cout << "Finished Grid " << gridMetdata.name << (solved ? "" : " (no solution)") << endl;
+        cout << "Total execution time: " << formatTime(start, finish) << endl;
+        cout << "Search nodes: " << stats.nodes << " backtracks: " << stats.backtracks << " nodes/sec: " << stats.nodesPerSecond() << endl;
+        cout << "Rule stats: ";
+        ruleStats.writeJSON(cout);
+        cout << endl << endl;
     }
     
     return 0;